@@ -2,6 +2,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __unix__
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#endif
 
 // MEMORY
 #define FORMATTED_MEMORY "memory_f.dat"
@@ -10,6 +32,57 @@
 #define WORD_BASE 16
 #define NUM_MEM_WORDS 100
 #define BUFFER_SIZE 15
+#define PATH_SIZE 256       // Longest source or object file path
+
+// EXTENDED MEMORY
+#define EXT_PAGE_WORDS 0x1000
+#define EXT_NUM_WORDS 0x1000000     // Addressed by two prefixes and an operand
+#define EXT_NUM_PAGES (EXT_NUM_WORDS / EXT_PAGE_WORDS)
+#define EXT_MAX_PREFIXES 2
+
+// ASSEMBLER STORAGE
+#define ARENA_BLOCK_SIZE 0x10000
+#define ARENA_ALIGN 16
+#define SYMBOLS_MIN_CAPACITY 64     // Power of two
+
+// FORMATTED MEMORY
+#define MEMF_COLS 10
+#define NUM_MEMF_ROWS ((NUM_MEM_WORDS + MEMF_COLS - 1) / MEMF_COLS)
+#define MEMF_ROW_LEN (3 + 10*MEMF_COLS)     // "%3u" row index then "   0x%04x " per word
+#define MEMF_HEADER_LEN (3 + 10*MEMF_COLS)  // Column index header
+#define MEMF_HEADER "           0         1         2         3         4         5         6         7         8         9\n"
+
+// OPTIMIZER
+#define OPT_LABELED 0x01    // Word flags
+#define OPT_PINNED 0x02     // Read as data, so never changed
+#define OPT_EXTERN 0x04     // Operand left for the linker
+#define OPT_REACHED 0x08
+#define OPT_TARGETED 0x10   // Branched to
+#define OPT_REMOVED 0x20
+
+// OBJECT FILES
+#define OBJECT_MAGIC "TOBJ"
+#define OBJECT_VERSION 2
+#define OBJECT_OPTIMIZED 0x1    // Header flag of objects the optimizer ran on
+#define MAX_MODULES 16
+
+// IMAGE CACHE
+#define ASSEMBLER_VERSION "TIMS assembler 4"    // Change whenever assembled output changes
+#define IMAGE_MAGIC "TIMS"
+#define IMAGE_VERSION 1
+#define IMAGE_NAME_FORMAT "tims-%016llx-%u.img"     // Source hash, load address
+#define IMAGE_NAME_SIZE 48
+
+// SNAPSHOTS
+#define SNAPSHOT_MAGIC "TSNP"
+#define SNAPSHOT_VERSION 1
+
+// LIVE VIEW
+#if defined(__unix__) && defined(_POSIX_SHARED_MEMORY_OBJECTS)
+#define LIVE_SUPPORTED
+#endif
+#define LIVE_MAGIC "TLIV"
+#define LIVE_VERSION 1
 
 // ERRORS
 #define MEM_ACC_ERR -1
@@ -19,8 +92,110 @@
 #define INV_INSTR -5
 #define INV_STR -6
 #define NO_LABEL -7
+#define INV_ADDR -8
+#define NO_IMAGE -9
+#define INSTR_LIMIT -10     // Stopped at instruction limit, can resume
+#define BAD_TRACE -11
+#define INPUT_WAIT -12      // Stopped for input yet to arrive, can resume
+#define BAD_SNAPSHOT -13
+#define BREAKPOINT -14      // Stopped before an instruction with a breakpoint, can resume
+#define WATCHPOINT -15      // Stopped after a store to a watched word, can resume
+#define BAD_VIEW -16
 #define NO_OPCODE 0x10000
 
+// I/O CHANNELS
+#define CHANNEL_BUFFER_SIZE 0x10000
+#define FORMAT_BUFFER_SIZE 256      // Longest formatted channel write
+#ifdef __GNUC__
+#define PRINTF_FORMAT(formatArg, firstArg) __attribute__((format(printf, formatArg, firstArg)))    // Check format arguments
+#else
+#define PRINTF_FORMAT(formatArg, firstArg)
+#endif
+
+// SCHEDULER
+#ifdef __linux__
+#define EPOLL_SUPPORTED
+#endif
+#define SCHED_SLICE 10000           // Default instructions per time slice
+#define SCHED_MAX_EVENTS 64         // Readiness events taken per wait
+
+// TRACES
+#define TRACE_MAGIC "TTRC"
+#define TRACE_VERSION 1
+#define TRACE_CHUNK_SIZE 0x4000     // Record bytes per chunk
+#define TRACE_NUM_CHUNKS 64         // Chunks kept in the ring buffer
+#define TRACE_RECORD_SIZE 16        // Longest encoded record
+#define ZIGZAG(n) (((unsigned long) (n) << 1) ^ (unsigned long) ((long int) (n) < 0 ? -1L : 0L))   // Small magnitudes to small varints
+#define UNZIGZAG(n) ((long int) ((n) >> 1) ^ -(long int) ((n) & 1))
+
+// DEBUGGER
+#define DEBUG_LINE_SIZE 80      // Longest debugger command
+#define DEBUG_BIT(bits, address) ((bits)[(address) / 8] & 1 << (address) % 8)
+#define STORES_MEMORY(handler) (H_RDI == (handler) || H_RDS == (handler) || H_STORE == (handler) \
+    || ((handler) >= H_BCPY && (handler) <= H_BADD) || H_CAS == (handler) || H_FADD == (handler))
+
+// SUPERINSTRUCTIONS
+#define NUM_FUSIONS 12
+#define FUSE_MAX_LENGTH 3
+#define FUSE_WARMUP 0x10000     // Instructions counted to choose superinstructions without a saved profile
+#define FUSE_MIN_SHARE 100      // Fused if saving at least 1 in this many dispatches
+#define FUSE_REPORT 10          // Hottest sequences of each length in profiles
+#define SEQ_NAME_SIZE 16        // Longest handler name in a sequence profile
+
+// BATCH
+#define DEFAULT_THREADS 4   // Used when the processor count is unknown
+#define SOURCE_EXTENSION ".txt"     // Sources assembled from directories
+
+// BENCHMARKS
+#define NUM_BENCHMARKS 7
+
+#define BENCH_BRANCH 0      // Tight B/BZ/BN loop
+#define BENCH_STRAIGHT 1    // Straight-line code filling memory
+#define BENCH_INT_IO 2      // RDI/PRTI loop
+#define BENCH_STR_IO 3      // RDS/PRTS loop
+#define BENCH_ASSEMBLER 4   // Large source with many labels, assembled only
+#define BENCH_BULK 5        // Bulk copy, fill, add and compare loop
+#define BENCH_COUNTER 6     // Counting loop of loads, adds and stores
+
+#define BENCH_INSTRUCTIONS 50000000     // Instructions run per compute benchmark
+#define BENCH_IO_INSTRUCTIONS 3000000   // Instructions run per I/O benchmark
+#define BENCH_ASM_LINES 80000           // Lines of assembler benchmark source, within object size limit
+
+// LIBRARY API
+// Compiling with TIMS_LIBRARY leaves out main(), embedding machines through the instance functions instead
+// Hosts copy or include this block, through to its end, after <stdio.h>
+#ifndef WORD_TYPE
+#define WORD_TYPE short
+#endif
+#ifndef INSTR_LIMIT
+#define INSTR_LIMIT -10     // run_instance() stopped by its limit, else 0 at END or another error below 0
+#endif
+
+// Machine for embedding, opaque to hosts
+typedef struct instance Instance;
+
+// Registers and counters of a machine
+typedef struct machineState {
+    size_t instrPtr;
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;
+    size_t instrCount;
+} MachineState;
+
+// Creates a machine for embedding
+Instance *create_instance( FILE *input, FILE *output );
+// Links and loads a program to a machine
+int load_instance( Instance *instance, char *objectNames[], size_t numModules, size_t address );
+// Runs a machine for at most some instructions
+int run_instance( Instance *instance, size_t numInstrs );
+// Reads a machine's registers and counters
+void query_instance( Instance *instance, MachineState *state );
+// Returns a machine to its loaded image
+void reset_instance( Instance *instance );
+// Frees a machine
+void destroy_instance( Instance *instance );
+// End of LIBRARY API
+
 // INSTRUCTION FORMATS
 #define BLK 0
 #define L__ 1
@@ -31,7 +206,7 @@
 #define _S_ 6
 
 // INSTRUCTIONS
-#define NUM_INSTR 8
+#define NUM_INSTR 20
 
 #define RDI 0x10
 #define RDS 0x11
@@ -41,621 +216,6696 @@
 #define BN 0x41
 #define BZ 0x42
 #define END 0x43
+#define EXT 0x20    // Extended address prefix, a NOP unless extended memory is in use
+#define LOAD 0x30
+#define STORE 0x31
+#define ADD 0x32
+#define SUB 0x33
+#define BCPY 0x50   // Bulk instructions take a parameter block of destination, source or value, and count
+#define BFIL 0x51
+#define BCMP 0x52
+#define BSCH 0x53
+#define BADD 0x54
+#define CAS 0x60    // Atomics, shared between the cores of a multi-core run
+#define FADD 0x61
+#define WAIT 0x62
 
+// DECODED INSTRUCTION HANDLERS
+#define NUM_HANDLERS 38
+#define NUM_SEQ_HANDLERS 25     // Handlers decoded from instruction words, counted in sequences
 
-// Node structure for linked list of program labels
-typedef struct label {
-    char name[BUFFER_SIZE];
-    size_t address;
-    struct label *next;
-} Label;
+#define H_RDI 0
+#define H_RDS 1
+#define H_PRTI 2
+#define H_PRTS 3
+#define H_B 4
+#define H_BN 5
+#define H_BZ 6
+#define H_END 7
+#define H_NOP 8         // Unrecognized opcode
+#define H_BAD_ADDR 9    // Operand or fetch outside of TIMS memory
+#define H_DECODE 10     // Invalidated by a store, decode again
+#define H_HOOK 11       // Profile or trace instruction before its handler
+#define H_EXTENDED 12   // Address prefix, extended operand or fetch from extended memory
+#define H_LOAD 13
+#define H_STORE 14
+#define H_ADD 15
+#define H_SUB 16
+#define H_BCPY 17
+#define H_BFIL 18
+#define H_BCMP 19
+#define H_BSCH 20
+#define H_BADD 21
+#define H_CAS 22
+#define H_FADD 23
+#define H_WAIT 24
+#define H_BREAK 25      // Breakpoint trap, decoded in place of the instruction under it
+#define H_LOAD_ADD_STORE 26     // Superinstructions, dispatched at the first word of their sequence
+#define H_LOAD_SUB_STORE 27
+#define H_LOAD_ADD 28
+#define H_LOAD_SUB 29
+#define H_ADD_STORE 30
+#define H_SUB_STORE 31
+#define H_LOAD_BZ 32
+#define H_LOAD_BN 33
+#define H_BZ_BN 34
+#define H_PRTI_B 35
+#define H_PRTS_B 36
+#define H_STORE_B 37
 
+#define POLL_INTERVAL 0x10000   // Maximum instructions between execution polls
 
-// Executes a TIMS program
-int execute( size_t *instrPtr, WORD_TYPE *instrReg, WORD_TYPE *accumulator );
-// Dump the register contents
-void dump( size_t *instrPtr, WORD_TYPE *instrReg, WORD_TYPE *accumulator );
-// Load a TIMS program to the memory file
-int load_program( char programName[], size_t address );
-// Assemble a TIMS assembly program
-int assemble_program( char fileName[], char *mnemonics[], WORD_TYPE opcodes[] );
-// Assemble TIMS assembly instructions to instruction words
-int assemble_instruction( WORD_TYPE *instrWord, char instr[], char *mnemonics[], WORD_TYPE opcodes[], Label *header );
-// Find and stores the addresses of all program labels
-Label *compile_labels( FILE *program );
-// Resolves any known program label references
-size_t resolve_label( char reference[], Label *header );
-// Determine the opcode of the given mnemonic
-int get_opcode( char mnemonic[], char *mnemonics[], WORD_TYPE opcodes[] );
-// Cleans a TIMS assembly instruction string
-int string_clean( char instr[], char destArray[][BUFFER_SIZE] );
-// Clears TIMS memory
-int clear_mem( void );
-// Syncs formatted memory
-int sync_memf( FILE *memory );
+// Use computed goto for direct-threaded dispatch where supported
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+#define THREADED_DISPATCH
+#endif
 
+// JIT
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_SUPPORTED
+#endif
 
+#define JIT_CODE_SIZE 0x4000    // Stubs plus every word compiled once
+#define JIT_INSTR_SIZE 80       // Longest compiled instruction, with a block's closing jump
 
-int main(int argc, char *argv[]) {
-    // Initialize valid TIMS commands
-    char *commands[NUM_INSTR] = {"RDI", "RDS", "PRTI", "PRTS", "B", "BN", "BZ", "END"};
-    WORD_TYPE codes[NUM_INSTR] = {RDI, RDS, PRTI, PRTS, B, BN, BZ, END};
+#define JIT_POLL 1          // Compiled code exit reasons, above the next instruction address
+#define JIT_MISS 2          // Branched to a word not yet compiled
+#define JIT_END 3
+#define JIT_BAD_ADDR 4
+#define JIT_FALLBACK 5      // Stored to compiled code, run on in the interpreter
+#define JIT_EXIT(reason, address) ((unsigned int) (reason) << 16 | (unsigned int) (address))
 
-    // Initialize TIMS registers
-    size_t instructionPointer = 0x0;
-    WORD_TYPE instructionRegister = 0x0;
-    WORD_TYPE accumulator = 0x0;
+// CORES
+#ifdef __linux__
+#define FUTEX_SUPPORTED
+#endif
 
+#define MAX_CORES 64
+#define CORE_WAIT_NS 1000000    // Longest WAIT sleep, bounding a wake missed by a store racing the sleep
 
-    clear_mem();
+// Relaxed atomic access to memory shared between cores
+#define SHARED_LOAD(mem, address) __atomic_load_n(&(mem)->words[address], __ATOMIC_RELAXED)
+#define SHARED_STORE(mem, address, value) __atomic_store_n(&(mem)->words[address], (WORD_TYPE) (value), __ATOMIC_RELAXED)
 
-    char programName[3*BUFFER_SIZE];
-    size_t loadAddr = 0x0;
+// BULK MEMORY
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VECTOR_KERNELS      // SSE2 kernels, widened to AVX2 where the CPU has it
+#endif
 
-    for (size_t i = 0; i < argc; i++) {
-        if (!strncmp(argv[i], "la-", 3)) {
-            loadAddr = strtol(&argv[i][3], NULL, 10);
-        } else {
-            strcpy(programName, argv[i]);
-        }
-    }
 
-    instructionPointer = loadAddr;
-    int assemblyStatus = assemble_program(programName, commands, codes);
-    if (!assemblyStatus) {
-        load_program(programName, loadAddr);
-        execute(&instructionPointer, &instructionRegister, &accumulator);
-    }
+// View of a token within program source
+typedef struct token {
+    const char *start;
+    size_t length;
+} Token;
 
-    return 0;
-}
+// Symbol table entry for a program label
+typedef struct label {
+    Token name;     // Empty if slot unused
+    size_t address;
+} Label;
 
+// Reference to a label not yet defined when assembled
+typedef struct fixup {
+    Token name;
+    size_t address;         // Word address of referencing instruction
+    WORD_TYPE instrWord;    // Instruction word without operand
+    size_t lineNum;
+    struct fixup *next;
+} Fixup;
 
+// Block of arena storage
+typedef struct arenaBlock {
+    struct arenaBlock *next;
+    size_t used;
+    size_t size;
+    _Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
 
-// ______________________________
-//           EXECUTION
-// ______________________________
+// Bump allocator freed all at once
+typedef struct arena {
+    ArenaBlock *head;
+} Arena;
 
+// Open-addressing hash table of program labels
+typedef struct symbolTable {
+    Label *slots;
+    size_t capacity;        // Power of two
+    size_t count;
+    Fixup *fixups;          // Forward references awaiting patch, in line order
+    Fixup *lastFixup;
+    Label *pendingLabel;    // Lone label awaiting an instruction
+    size_t pendingLine;
+    Arena *arena;
+} SymbolTable;
 
+// In-RAM image of TIMS memory
+typedef struct memory {
+    WORD_TYPE words[NUM_MEM_WORDS];
+    unsigned char dirtyRows[(NUM_MEMF_ROWS + 7) / 8];   // Formatted rows awaiting sync
+    WORD_TYPE **pages;      // Extended memory page table, NULL unless extended memory is in use
+} Memory;
 
-// Executes TIMS program from the word address in the instruction pointer
-int execute( size_t *instrPtr, WORD_TYPE *instrReg, WORD_TYPE *accumulator ) {
-    FILE *memory = fopen(MEMORY, "r+");     // Open memory
-    if (NULL == memory) { return MEM_ACC_ERR; }
+// Buffered stream for RDI/RDS input or PRTI/PRTS output
+typedef struct channel {
+    FILE *file;             // File, pipe or terminal
+    char *data;
+    size_t start;           // Next unread input byte
+    size_t length;          // Bytes buffered
+    struct channel *tie;    // Output flushed before input blocks
+    int eof;                // Input exhausted
+    int error;              // Write failed
+    int nonblocking;        // Input never waits, RDI and RDS stop with INPUT_WAIT instead
+    int writerPending;      // FIFO input no writer has opened yet, reading nothing without being at its end
+} Channel;
 
-    WORD_TYPE ioIntBuff = 0x0;      // I/O integer buffer
-    char ioStrBuff[10*BUFFER_SIZE]; // I/O string buffer
-    WORD_TYPE memTransferBuff = 0x0;    // Memory-register transfer buffer
+// Self-contained TIMS machine state
+typedef struct machine {
+    size_t instrPtr;
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;
+    int ioIntBuff;          // Last integer read, stored again if RDI reads none
+    Memory mem;             // Private RAM memory image
+    Channel *input;         // RDI/RDS source
+    Channel *output;        // PRTI/PRTS destination
+    int persist;            // Write back to the memory files
+    size_t checkpoint;      // Instructions between memory write-backs (0 = END only)
+    size_t syncInterval;    // Instructions between formatted memory syncs (0 = END only)
+    size_t instrLimit;      // Instructions per execute() before stopping (0 = no limit)
+    size_t instrCount;      // Instructions executed
+    struct profile *profile;    // Execution counters, NULL unless profiling
+    struct trace *trace;        // Execution trace, NULL unless tracing
+    struct debugger *debugger;  // Breakpoints and watchpoints, NULL unless debugging
+    unsigned int fusions;       // Superinstructions fused, a bit per catalog entry
+    size_t fusedCount;          // Instructions run inside superinstructions, without a dispatch of their own
+    struct liveView *live;      // Shared-memory view of registers and memory, NULL unless published
+} Machine;
 
-    size_t instrAddr = *instrPtr * sizeof(WORD_TYPE);   // Instruction byte-address
-    size_t operAddr = 0x0;  // Operand byte-address
+// Registers and base memory published to shared memory for monitors
+// Readers retry while the sequence is odd or changes under them, so the machine never waits on them
+typedef struct liveView {
+    char magic[4];              // LIVE_MAGIC
+    unsigned int version;       // LIVE_VERSION
+    unsigned int sequence;      // Odd while being written
+    unsigned int instrPtr;
+    unsigned long long instrCount;
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;
+    WORD_TYPE words[NUM_MEM_WORDS];
+} LiveView;
 
-    fseek(memory, instrAddr, SEEK_SET); // Seek to program start
+// Breakpoints and watchpoints of a debugged machine, a bit for each base memory word
+typedef struct debugger {
+    unsigned char breakpoints[(NUM_MEM_WORDS + 7) / 8];
+    unsigned char watchpoints[(NUM_MEM_WORDS + 7) / 8];
+    size_t numWatchpoints;  // Stores go unchecked while none are set
+    size_t watchHit;        // Watched word the last stopping store wrote
+    FILE *commands;         // Debugger command source
+} Debugger;
 
-    WORD_TYPE opcode = 0x0; // Instruction components
-    WORD_TYPE operand = 0x0;
+// Batch manifest job
+typedef struct job {
+    char program[3*BUFFER_SIZE];
+    char object[3*BUFFER_SIZE];
+    size_t address;         // Load address
+    char *input;            // Input file name
+    char *output;           // Output file name
+    int status;             // Result of run
+} Job;
 
-    puts("\n_____Executing TIMS Program_____\n");
+// Worker's deque of job indices, owner takes from the bottom and thieves from the top
+typedef struct jobQueue {
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t top;
+    size_t bottom;
+} JobQueue;
 
-    fread(instrReg, sizeof(WORD_TYPE), 1, memory);  // Fetch first instruction
-    opcode = *instrReg / 0x100;     // Decode
-    operand = *instrReg % 0x100;
-    operAddr = operand * sizeof(WORD_TYPE);     // Operand byte-address
+// Jobs shared by a pool of workers
+typedef struct batch {
+    Job *jobs;
+    size_t numJobs;
+    JobQueue *queues;       // One per worker
+    size_t numQueues;
+} Batch;
 
-    // Execute entire program
-    while (END != opcode) {
-        // Execute instruction
-        switch (opcode) {
-            // I/O
-            case RDI:   // Read integer from terminal to memory
-                scanf("%d", &ioIntBuff);
-                fseek(memory, operAddr, SEEK_SET);
-                fwrite(&ioIntBuff, sizeof(ioIntBuff), 1, memory);
-                sync_memf(memory);
-                break;
-            case RDS:   // Read string from terminal to memory
-                gets(ioStrBuff);
-                fseek(memory, operAddr, SEEK_SET);
-                fwrite(ioStrBuff, sizeof(ioStrBuff[0]), strlen(ioStrBuff), memory);
-                sync_memf(memory);
-                break;
-            case PRTI:  // Print integer from memory
-                fseek(memory, operAddr, SEEK_SET);
-                fread(&ioIntBuff, sizeof(ioIntBuff), 1, memory);
-                printf("%d\n", ioIntBuff);
-                break;
-            case PRTS:  // Print string from memory
-                fseek(memory, operAddr, SEEK_SET);
-                fread(ioStrBuff, sizeof(ioStrBuff[0]), 10*BUFFER_SIZE, memory);
-                printf("%s\n", ioStrBuff);
-                break;
-            case B:     // Unconditional branch
-                *instrPtr = operand - 1;
-                break;
-            case BN:    // Branch if accumulator negative
-                if (*accumulator < 0) {
-                    *instrPtr = operand - 1;
-                }
-                break;
-            case BZ:    // Branch if accumulator zero
-                if (!(*accumulator)) {
-                    *instrPtr = operand - 1;
-                }
-                break;
-        }
+// Batch worker thread
+typedef struct worker {
+    pthread_t thread;
+    Batch *batch;
+    size_t queue;           // Own queue index
+} Worker;
 
-        // Fetch next instruction
-        (*instrPtr)++;
-        instrAddr = *instrPtr * sizeof(WORD_TYPE);
-        fseek(memory, instrAddr, SEEK_SET);
-        fread(instrReg, sizeof(WORD_TYPE), 1, memory);
+// Source assembled by a build, with the diagnostics it printed
+typedef struct asmJob {
+    char source[PATH_SIZE];
+    char object[PATH_SIZE];
+    FILE *log;              // Diagnostics, replayed in source order
+    int status;
+    int unchanged;          // Object newer than source, so not assembled
+} AsmJob;
 
-        // Decode instruction
-        opcode = *instrReg / 0x100;
-        operand = *instrReg % 0x100;
-        operAddr = operand * sizeof(WORD_TYPE);
-    }
+// Sources assembled by a pool of threads, each taking the next unassembled source
+typedef struct build {
+    AsmJob *jobs;
+    size_t numJobs;
+    size_t next;            // Next job to take
+    char **mnemonics;       // Shared and read only
+    WORD_TYPE *opcodes;
+    int optimize;
+} Build;
 
-    if (fclose(memory)) { return MEM_ACC_ERR; } // Close memory
+// Emulated CPU of a multi-core run, with its own registers and performance counters
+typedef struct core {
+    pthread_t thread;
+    struct cluster *cluster;
+    size_t instrPtr;
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;  // Starts as the core number
+    int ioIntBuff;
+    int status;
+    size_t instrCount;
+    size_t numAtomics;      // CAS and FADD executed
+    size_t numCasFailed;
+    size_t numWaits;        // WAITs that slept
+    double waitSeconds;
+    double execSeconds;
+} Core;
 
-    puts("\n_____TIMS Execution Complete_____\n");
-    dump(instrPtr, instrReg, accumulator);
+// Cores sharing one machine's memory image and I/O channels
+typedef struct cluster {
+    Machine *vm;
+    Core cores[MAX_CORES];
+    size_t numCores;
+    pthread_mutex_t ioLock;     // Channels are used by one core at a time
+    int waiters;                // Cores sleeping in WAIT
+    int running;                // Cores yet to stop
+} Cluster;
 
-    return 0;
-}
+// Scheduled interactive job, run a time slice at a time
+typedef struct session {
+    Job *job;
+    Machine vm;
+    Channel input;          // Non-blocking
+    Channel output;
+    FILE *inputFile;
+    FILE *outputFile;
+    size_t numSlices;
+    size_t numWaits;        // Suspensions for input
+} Session;
 
+// Word offsets of an assembled program that hold program addresses
+typedef struct relocTable {
+    unsigned short *offsets;
+    size_t count;
+} RelocTable;
 
+// Header of a relocatable object file
+// Followed by the words, relocation offsets, exported label records and external reference records
+typedef struct objectHeader {
+    char magic[4];              // OBJECT_MAGIC
+    unsigned short version;     // OBJECT_VERSION
+    unsigned short numWords;
+    unsigned short numRelocs;
+    unsigned short numSymbols;  // Labels defined by the module
+    unsigned short numExterns;  // References to labels the module doesn't define
+    unsigned short flags;       // OBJECT_OPTIMIZED
+} ObjectHeader;
 
-// Dump the register contents
-void dump( size_t *instrPtr, WORD_TYPE *instrReg, WORD_TYPE *accumulator ) {
-    puts("\nREGISTERS:");
-    printf("%-24s0x%02x\n", "Instruction Pointer", *instrPtr);
-    printf("%-22s0x%04x\n", "Instruction Register", *instrReg);
-    printf("%-22s0x%04x\n\n", "Accumulator", *accumulator);
-    exit(EXIT_SUCCESS);
-}
+// Object file label record, followed by its name padded to an even length
+typedef struct objectSymbol {
+    unsigned short address;     // Module word offset of label or reference
+    unsigned short lineNum;     // Source line of reference
+    unsigned short nameLength;
+} ObjectSymbol;
 
+// Object file read for linking
+typedef struct module {
+    char *object;               // Whole object file
+    ObjectHeader *header;
+    WORD_TYPE *words;
+    unsigned short *relocs;
+    char *symbols;              // First exported label record
+    char *externs;              // First external reference record
+    size_t base;                // Load address
+} Module;
 
+// Header of a cached, relocated program image
+typedef struct imageHeader {
+    char magic[4];              // IMAGE_MAGIC
+    unsigned short version;     // IMAGE_VERSION
+    unsigned short numWords;
+    unsigned short address;     // Load address words are relocated for
+    unsigned short entry;       // Initial instruction pointer
+} ImageHeader;
 
-// ______________________________
-//            ASSEMBLY
-// ______________________________
+// Cached program image, read and written whole
+typedef struct image {
+    ImageHeader header;
+    WORD_TYPE words[NUM_MEM_WORDS];
+} Image;
 
+// Header of a machine snapshot, followed by base memory and a record for each extended page holding data
+typedef struct snapshotHeader {
+    char magic[4];              // SNAPSHOT_MAGIC
+    unsigned int version;       // SNAPSHOT_VERSION
+    unsigned long long instrCount;
+    unsigned int instrPtr;
+    unsigned int numPages;      // Page records following base memory
+    int ioIntBuff;
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;
+    unsigned int extended;      // Extended memory in use, even if every page is empty
+} SnapshotHeader;
 
+// Extended memory page as stored in snapshots, as in the memory file
+typedef struct pageRecord {
+    unsigned int page;
+    WORD_TYPE words[EXT_PAGE_WORDS];
+} PageRecord;
 
-// Assembles a TIMS programs
-int assemble_program( char fileName[], char *mnemonics[], WORD_TYPE opcodes[] ) {
-    char programName[3*BUFFER_SIZE];
-    strcpy(programName, fileName);  // Copy program name
+// Execution counters gathered while profiling
+typedef struct profile {
+    size_t counts[NUM_HANDLERS];        // Instructions executed per handler
+    size_t taken[NUM_HANDLERS];         // Branches taken per handler
+    size_t hits[NUM_MEM_WORDS + 1];     // Instructions executed per word, plus end of memory
+    int handlers[NUM_MEM_WORDS + 1];    // Last handler executed per word
+    double ioSeconds;                   // Wall time in I/O instructions
+    double totalSeconds;                // Wall time in execute()
+    double ioStart;                     // Start of executing I/O instruction, 0 if none
+    size_t pairs[NUM_SEQ_HANDLERS][NUM_SEQ_HANDLERS];   // Handlers run straight after another
+    size_t triples[NUM_SEQ_HANDLERS][NUM_SEQ_HANDLERS][NUM_SEQ_HANDLERS];
+    size_t runLength;                   // Instructions run straight through up to the last
+    size_t lastAddress;
+    int lastHandlers[FUSE_MAX_LENGTH - 1];  // Last handler first
+} Profile;
 
-    // Get output file name
-    char assembledName[3*BUFFER_SIZE];
-    strcpy(assembledName, strtok(fileName, "."));
-    strcat(assembledName, "Asm.");
-    strcat(assembledName, strtok(NULL, "."));
+// Superinstruction of the catalog, fused from a sequence of instructions run straight through
+typedef struct fusion {
+    int handler;
+    size_t length;
+    int sequence[FUSE_MAX_LENGTH];
+} Fusion;
 
-    strcpy(fileName, assembledName);    // Return output file name in fileName[]
+// Profile counter for sorting
+typedef struct profileEntry {
+    size_t count;
+    size_t index;           // Handler or word
+} ProfileEntry;
 
-    FILE *program = fopen(programName, "r");    // Open program
-    if (NULL == program) { return PROG_ACC_ERR; }
+// Trace chunk header, holding the state its records are decoded from
+typedef struct traceKeyframe {
+    unsigned int used;              // Record bytes that follow
+    int instrPtr;                   // Last traced instruction
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;
+    WORD_TYPE words[NUM_MEM_WORDS]; // Memory when chunk started
+} TraceKeyframe;
 
-    FILE *assembledFile = fopen(assembledName, "w");    // Create/open output file
-    if (NULL == assembledFile) { return PROG_ACC_ERR; }
+// Chunk of trace records, each an instruction as deltas from the last or a memory word written by the last
+// Instructions are a varint address delta, 16-bit word XOR and varint accumulator delta
+typedef struct traceChunk {
+    TraceKeyframe key;
+    unsigned char records[TRACE_CHUNK_SIZE];
+} TraceChunk;
 
-    Label *header = compile_labels(program);    // Compile all program labels
+// Ring buffer of trace chunks, oldest overwritten first
+typedef struct trace {
+    char *fileName;
+    TraceChunk *chunks;
+    TraceChunk *chunk;      // Newest chunk, NULL before the first record
+    size_t numChunks;       // Chunks started, the last TRACE_NUM_CHUNKS kept
+    int instrPtr;           // Last traced instruction
+    WORD_TYPE instrReg;
+    WORD_TYPE accumulator;
+} Trace;
 
-    char readBuff[11*BUFFER_SIZE];              // Program read buffer
-    WORD_TYPE writeBuff[BUFFER_SIZE] = {0x0};   // Assembled word write buffer
+// Header of a trace file, followed by each chunk's keyframe and records, oldest first
+typedef struct traceHeader {
+    char magic[4];              // TRACE_MAGIC
+    unsigned short version;     // TRACE_VERSION
+    unsigned short numChunks;
+} TraceHeader;
 
-    size_t lineNum = 1;
-    unsigned int numErrors = 0;
+// Machine for embedding, run again and again from the image it loaded
+struct instance {
+    Machine vm;
+    Channel input;
+    Channel output;
+    WORD_TYPE image[NUM_MEM_WORDS];     // Base memory as loaded
+    size_t entry;                       // Load address, where runs start
+};
 
-    // Read program
-    while (!feof(program)) {
-        fgets(readBuff, sizeof(readBuff), program);
-        
-        int asmWords = assemble_instruction(writeBuff, readBuff, mnemonics, opcodes, header);   // Assemble instruction
-        
-        switch (asmWords) {
-            case 0: // Skip blank lines
-                lineNum++;
-                continue;
-            case INV_INSTR: // Invalid instruction
-                printf("Line %u - invalid instruction\n", lineNum);
-                numErrors++;
-                lineNum++;
-                continue;
-            case INV_STR:   // Invalid string literal
-                printf("Line %u - invalid string\n", lineNum);
-                numErrors++;
-                lineNum++;
-                continue;
-        }
-        
-        fwrite(writeBuff, sizeof(WORD_TYPE), asmWords, assembledFile);  // Write words
-        lineNum++;
-    }
+// Measurements of one benchmark
+typedef struct benchResult {
+    size_t asmLines;
+    double asmSeconds;
+    size_t numWords;        // Words loaded
+    size_t instructions;
+    double execSeconds;
+    size_t dispatches;      // Dispatches with superinstructions fused
+    double fusedSeconds;    // Execution time with superinstructions fused
+    long int peakRss;       // Kilobytes, 0 if unknown
+} BenchResult;
 
-    if (fclose(program)) { return PROG_ACC_ERR; }   // Close files
-    if (fclose(assembledFile)) { return PROG_ACC_ERR; }
+// Pre-decoded TIMS instruction
+typedef struct decoded {
+#ifdef THREADED_DISPATCH
+    void *label;        // Address of dispatched handler in execute()
+#else
+    int entry;          // Dispatched handler
+#endif
+    int handler;
+    WORD_TYPE operand;
+    size_t target;      // Next instruction address if branch taken
+} Decoded;
 
-    if (numErrors) {
-        printf("\nFailed to assemble \"%s\": %u errors contained\n\n", programName, numErrors);
-        return BAD_PROGRAM;
-    } else {
-        printf("\nAssembled \"%s\" to \"%s\"\n\n", programName, assembledName);
-        return 0;
-    }
-}
 
+// Native code compiled from a machine's memory image
+// Compiled code keeps the JIT in rbx, the accumulator address in r12 and the remaining instructions in r13
+typedef struct jit {
+    void *entries[NUM_MEM_WORDS + 1];   // Compiled code of each word, else its miss stub
+    void *pollStubs[NUM_MEM_WORDS + 1]; // Exits to poll before each word
+    WORD_TYPE *accumulator;
+    size_t remaining;       // Instructions to run before the next poll
+    Machine *vm;
+    unsigned char *code;    // Code buffer, writable only while compiling
+    size_t used;
+    void *epilogue;         // Returns the exit reason to execute_jit()
+    unsigned int (*enter)( struct jit *jit, void *code );   // Trampoline into compiled code
+    unsigned char compiled[NUM_MEM_WORDS + 1];  // Words with compiled code
+} Jit;
 
 
-// Assemble TIMS assembly instruction to TIMS instruction word
-// Returns the number of instruction words assembled (multiple if string)
-int assemble_instruction( WORD_TYPE *instrWord, char instruction[], char *mnenonics[], WORD_TYPE opcodes[], Label *header ) {
-    // Clean instruction string and determine format
-    char components[3][BUFFER_SIZE];
-    int format = string_clean(instruction, components);
-    
-    int opcode = 0x0;
-    int operand = 0x0;
-    size_t numStrWordsAsm = 0;
-    // Assemble instruction word
-    switch (format) {
-        case _IR_:  // Instruction, reference operand
-            operand = resolve_label(components[2], header);
-            opcode = get_opcode(components[1], mnenonics, opcodes);
-            if (NO_OPCODE == opcode) { return INV_INSTR; }  // Invalid command error
-            instrWord[0] = (WORD_TYPE) (opcode * 0x100 + operand);
-            return 1;
-        case _IL_:  // Instruction, operand literal
-            if (!strncmp(components[2], "0x", 2) || !strncmp(components[2], "0X", 2)) {
-                operand = strtol(&components[2][2], NULL, 16);  // Hexadecimal literal
-            } else if (!strcmp(components[2], "0")) {
-                operand = strtol(components[2], NULL, 8);   // Octal literal
-            } else {
-                operand = strtol(components[2], NULL, 10);  // Decimal literal
-            }
-            opcode = get_opcode(components[1], mnenonics, opcodes);
-            if (NO_OPCODE == opcode) { return INV_INSTR; }  // Invalid command error
-            instrWord[0] = (WORD_TYPE) (opcode * 0x100 + operand);
-            return 1;
-        case _I_:   // No-operand instruction
-            opcode = get_opcode(components[1], mnenonics, opcodes);
-            if (NO_OPCODE == opcode) { return INV_INSTR; }  // Invalid command error
-            instrWord[0] = (WORD_TYPE) opcode * 0x100;
-            return 1;
-        case _D_:   // Data word
-            if (!strncmp(components[1], "0x", 2) || !strncmp(components[1], "0X", 2)) {
-                operand = strtol(&components[1][2], NULL, 16);  // Hexadecimal literal
-            } else if (!strcmp(components[1], "0")) {
-                operand = strtol(components[1], NULL, 8);   // Octal literal
-            } else {
-                operand = strtol(components[1], NULL, 10);  // Decimal literal
-            }
-            instrWord[0] = (WORD_TYPE) operand;
-            return 1;
-        case _S_:   // String data
-            for (numStrWordsAsm = 0; numStrWordsAsm < (strlen(instruction) + 1) / 2; numStrWordsAsm++) {
-                instrWord[numStrWordsAsm] = (WORD_TYPE) (instruction[2*numStrWordsAsm + 1] * 0x100 + instruction[2*numStrWordsAsm]);
-            }
-            return numStrWordsAsm;  
-        case INV_STR:   // Invalid string literal
-            instrWord[0] = (WORD_TYPE) 0x0;
-            return INV_STR;
-        case BLK:   // Ignore blank lines
-        case L__:
-            return 0;
-        default:    // Unrecognized format
-            instrWord[0] = (WORD_TYPE) 0x0;
-            return INV_INSTR;
-    }
-}
+// Set by SIGUSR1 to request a formatted memory refresh during execution
+static volatile sig_atomic_t memfRefresh = 0;
+// Set by SIGUSR2 to request the execution trace be written
+static volatile sig_atomic_t traceRequest = 0;
 
+// Superinstructions the interpreter can fuse, longest first as overlapping sequences fuse the first that matches
+static const Fusion fusionCatalog[NUM_FUSIONS] = {
+    {H_LOAD_ADD_STORE, 3, {H_LOAD, H_ADD, H_STORE}}, {H_LOAD_SUB_STORE, 3, {H_LOAD, H_SUB, H_STORE}},
+    {H_LOAD_ADD, 2, {H_LOAD, H_ADD}}, {H_LOAD_SUB, 2, {H_LOAD, H_SUB}},
+    {H_ADD_STORE, 2, {H_ADD, H_STORE}}, {H_SUB_STORE, 2, {H_SUB, H_STORE}},
+    {H_LOAD_BZ, 2, {H_LOAD, H_BZ}}, {H_LOAD_BN, 2, {H_LOAD, H_BN}}, {H_BZ_BN, 2, {H_BZ, H_BN}},
+    {H_PRTI_B, 2, {H_PRTI, H_B}}, {H_PRTS_B, 2, {H_PRTS, H_B}}, {H_STORE_B, 2, {H_STORE, H_B}}
+};
 
 
-// Finds and stores the addresses of all program labels
-Label *compile_labels( FILE *program ) {
-    if (NULL == program) { return NULL; }   // Ensure program file open
-    // Create label list
-    Label *header = NULL;
-    Label *prevNode = NULL;
-    // Instruction read buffers
-    char buffer[3*BUFFER_SIZE];
-    char segments[3][BUFFER_SIZE];
+// Executes a TIMS program
+int execute( Machine *vm );
+// Interprets a TIMS program
+int interpret( Machine *vm, size_t instrCount );
+// Polls a running machine
+size_t poll_machine( Machine *vm, size_t ip, size_t instrCount, int *status );
+// Stops a machine
+int stop_machine( Machine *vm, size_t ip, size_t instrCount, int status );
+// Pre-decodes an instruction word
+void decode_instr( Memory *mem, size_t address, Decoded *instr, Debugger *debugger );
+// Decodes an instruction with its address prefixes
+size_t decode_word( Memory *mem, size_t address, Decoded *instr );
+// Decodes the fields of an instruction word
+void decode_fields( WORD_TYPE word, size_t extension, size_t limit, Decoded *instr );
+// Executes an instruction on extended memory
+int step_extended( Machine *vm, size_t *ip, size_t stored[2] );
+// Runs CAS or FADD on a single core
+int execute_atomic( Memory *mem, int handler, size_t address, WORD_TYPE *accumulator );
+// Runs a bulk memory instruction
+int execute_bulk( Memory *mem, int handler, size_t params, WORD_TYPE *accumulator, size_t stored[2] );
+// Checks a bulk memory range
+int bulk_range( Memory *mem, size_t address, size_t count );
+// Fills words with a value
+void bulk_fill( WORD_TYPE dst[], WORD_TYPE value, size_t count );
+// Finds the first difference between words
+size_t bulk_compare( const WORD_TYPE a[], const WORD_TYPE b[], size_t count );
+// Finds the first word equal to a value
+size_t bulk_search( const WORD_TYPE words[], WORD_TYPE value, size_t count );
+// Adds words to words
+void bulk_add( WORD_TYPE dst[], const WORD_TYPE src[], size_t count );
+#ifdef VECTOR_KERNELS
+// Fills whole AVX2 vectors
+__attribute__((target("avx2"))) size_t fill_avx2( WORD_TYPE dst[], WORD_TYPE value, size_t count );
+// Compares whole AVX2 vectors
+__attribute__((target("avx2"))) size_t compare_avx2( const WORD_TYPE a[], const WORD_TYPE b[], size_t count );
+// Searches whole AVX2 vectors
+__attribute__((target("avx2"))) size_t search_avx2( const WORD_TYPE words[], WORD_TYPE value, size_t count );
+// Adds whole AVX2 vectors
+__attribute__((target("avx2"))) size_t add_avx2( WORD_TYPE dst[], const WORD_TYPE src[], size_t count );
+#endif
+// Dump the register contents
+void dump( Machine *vm );
+// Executes a TIMS program as native code
+int execute_jit( Machine *vm );
+// Allocates a JIT and its code buffer
+Jit *open_jit( Machine *vm );
+// Frees a JIT
+void close_jit( Jit *jit );
+// Compiles a basic block
+int compile_block( Jit *jit, size_t start );
+// Emits code bytes
+void emit( Jit *jit, size_t length, ... );
+// Emits a 32 bit immediate
+void emit32( Jit *jit, unsigned int value );
+// Emits a 32 bit relative jump offset
+void emit_rel32( Jit *jit, void *target );
+// Emits an exit from compiled code
+void emit_exit( Jit *jit, unsigned int exit );
+// Emits a helper call
+void emit_call( Jit *jit, void *helper, WORD_TYPE operand );
+// Emits a branch
+void emit_branch( Jit *jit, unsigned char condition, size_t target );
+// Reads an integer for compiled code
+int jit_rdi( Jit *jit, int address );
+// Reads a string for compiled code
+int jit_rds( Jit *jit, int address );
+// Prints an integer for compiled code
+void jit_prti( Jit *jit, int address );
+// Prints a string for compiled code
+void jit_prts( Jit *jit, int address );
+// Stores the accumulator for compiled code
+int jit_store( Jit *jit, int address );
+// Runs a bulk instruction for compiled code
+int jit_bulk( Jit *jit, int address );
+// Runs an atomic instruction for compiled code
+int jit_atomic( Jit *jit, int address );
+// Emits a load of a memory word
+void emit_load( Jit *jit, WORD_TYPE address );
+// Translates a loaded program to C
+int translate_program( char fileName[], Memory *mem, size_t entry );
+// Counts an instruction about to execute
+void profile_instr( Profile *profile, size_t address, int handler, WORD_TYPE accumulator );
+// Opens an empty trace
+int open_trace( Trace *trace, char fileName[] );
+// Frees a trace
+void close_trace( Trace *trace );
+// Records an instruction about to execute
+void trace_instr( Trace *trace, Memory *mem, size_t address, WORD_TYPE instrWord, WORD_TYPE accumulator );
+// Records a memory word written by the last instruction
+void trace_write( Trace *trace, Memory *mem, size_t address );
+// Finds room for a trace record
+unsigned char *next_record( Trace *trace, Memory *mem );
+// Encodes a varint
+size_t put_varint( unsigned char bytes[], unsigned long value );
+// Decodes a varint
+size_t get_varint( const unsigned char bytes[], size_t length, unsigned long *value );
+// Writes the trace ring buffer to its file
+int write_trace( Trace *trace );
+// Replays a trace file
+int replay_trace( char fileName[], Channel *output );
+// Requests the trace be written from a signal
+void request_trace( int sig );
+// Runs a machine under the debugger
+int debug_machine( Machine *vm, Debugger *debugger );
+// Runs a debugged machine on
+int debug_run( Machine *vm, size_t numSteps );
+// Checks stored words for watchpoints
+int watch_hit( Debugger *debugger, size_t first, size_t last );
+// Prints memory words for the debugger
+void debug_words( Machine *vm, size_t address, size_t count );
+// Names a decoded instruction handler
+const char *handler_name( int handler );
+// Orders profile counters by descending count
+int compare_entries( const void *a, const void *b );
+// Prints a sorted profile report
+void print_profile( Profile *profile, FILE *report );
+// Writes a profile as folded stacks
+int write_folded( Profile *profile, char fileName[] );
+// Prints the hottest sequences of a profile
+void print_sequences( Profile *profile, FILE *report, size_t length );
+// Runs a program with superinstructions fused
+int execute_fused( Machine *vm, Profile *sequences );
+// Chooses the superinstructions to fuse
+unsigned int select_fusions( Profile *profile );
+// Finds the superinstruction starting at a word
+int fuse_instr( const Decoded cache[], size_t address, unsigned int fusions );
+// Writes a sequence profile
+int write_sequences( Profile *profile, char fileName[] );
+// Reads a sequence profile
+int read_sequences( Profile *profile, char fileName[] );
+// Finds a handler by name
+int sequence_handler( const char name[] );
+// Name the object file of a source
+void object_name( char objectName[], const char sourceName[] );
+// Assemble a TIMS assembly program
+int assemble_program( char fileName[], char *mnemonics[], WORD_TYPE opcodes[], int optimize, FILE *log );
+// Read a whole file
+char *read_file( char fileName[], size_t *length );
+// Assemble TIMS assembly instructions to instruction words
+int assemble_instruction( WORD_TYPE *instrWord, unsigned char code[], const char line[], size_t length, char *mnemonics[], WORD_TYPE opcodes[], SymbolTable *symbols, RelocTable *relocs, size_t address, size_t lineNum );
+// Optimize an assembled program
+int optimize_program( char programName[], WORD_TYPE words[], size_t *numWords, unsigned char code[], RelocTable *relocs, SymbolTable *symbols, FILE *log );
+// Mark the code reachable from a program's entry and labels
+int mark_reachable( WORD_TYPE words[], size_t numWords, unsigned char code[], unsigned char flags[], size_t pending[] );
+// Parse a numeric literal
+int parse_literal( Token literal );
+// Determine the opcode of the given mnemonic
+int get_opcode( Token mnemonic, char *mnemonics[], WORD_TYPE opcodes[] );
+// Compare a token to a string
+int token_equals( Token token, const char string[] );
+// Find the next token in a line
+Token next_token( const char *start, const char *end );
+// Split a TIMS assembly instruction into components
+int tokenize_line( const char line[], size_t length, Token components[3] );
+// Allocates storage from an arena
+void *arena_alloc( Arena *arena, size_t size );
+// Frees all arena storage
+void free_arena( Arena *arena );
+// Initializes an empty symbol table
+int init_symbols( SymbolTable *symbols, Arena *arena );
+// Hashes a label name
+size_t hash_label( Token name );
+// Compares two label names
+int labels_equal( Token a, Token b );
+// Finds the symbol table slot of a label name
+Label *find_slot( Label slots[], size_t capacity, Token name );
+// Defines a program label
+Label *define_label( SymbolTable *symbols, Token name, size_t address );
+// Resolves any known program label references
+size_t resolve_label( Token reference, SymbolTable *symbols );
+// Records a forward label reference
+int add_fixup( SymbolTable *symbols, Token name, size_t address, WORD_TYPE instrWord, size_t lineNum );
+// Patches forward label references
+unsigned int patch_fixups( SymbolTable *symbols, WORD_TYPE words[], RelocTable *relocs );
+// Writes a relocatable object file
+int write_object( char objectName[], WORD_TYPE words[], size_t numWords, RelocTable *relocs, SymbolTable *symbols, int optimized );
+// Writes an object file label record
+void write_symbol( FILE *object, size_t address, size_t lineNum, Token name );
+// Finds the next object file label record
+char *next_symbol( char *record );
+// Reads an object file
+int read_object( char objectName[], Module *module );
+// Link TIMS object files and load them to the memory file, returning the word count
+int link_program( char *objectNames[], size_t numModules, size_t address, Memory *mem, FILE *log );
+// Hashes program sources with the assembler version
+unsigned long long hash_program( char *programNames[], size_t numPrograms, int optimize );
+// Loads a cached program image to TIMS memory
+int load_image( unsigned long long hash, size_t address, Memory *mem, size_t *entry );
+// Caches a loaded program image
+int cache_image( unsigned long long hash, size_t address, size_t numWords, Memory *mem );
+// Captures a machine's registers and memory in one block
+char *build_snapshot( Machine *vm, size_t *size );
+// Resumes a machine from a captured block
+int restore_snapshot( Machine *vm, const char snapshot[], size_t size );
+// Writes a machine snapshot file
+int save_snapshot( Machine *vm, char snapshotName[] );
+// Resumes a machine from a snapshot file
+int load_snapshot( Machine *vm, char snapshotName[] );
+// Places program words in TIMS memory
+void place_words( Memory *mem, WORD_TYPE words[], size_t numWords, size_t address );
+// Clears TIMS memory
+int clear_mem( void );
+// Allocates an empty extended memory page table
+int init_pages( Memory *mem );
+// Frees extended memory
+void free_pages( Memory *mem );
+// Finds a word of base or extended memory
+WORD_TYPE *page_word( Memory *mem, size_t address, int allocate );
+// Reads a word of base or extended memory
+WORD_TYPE read_word( Memory *mem, size_t address );
+// Reads TIMS memory into RAM
+int read_mem( Memory *mem );
+// Writes a RAM memory image back to TIMS memory
+int write_mem( Memory *mem );
+// Marks the formatted memory row of a word for sync
+void mark_dirty( Memory *mem, size_t word );
+// Syncs formatted memory
+int sync_memf( Memory *mem );
+// Writes a row of formatted memory
+void write_memf_row( FILE *memf, const WORD_TYPE words[], size_t row );
+// Requests a formatted memory sync from a signal
+void request_memf_refresh( int sig );
+// Opens a buffered channel on a stream
+int open_channel( Channel *channel, FILE *file );
+// Flushes and frees a channel
+int close_channel( Channel *channel );
+// Refills an input channel
+size_t fill_channel( Channel *channel );
+// Writes out buffered channel output
+int flush_channel( Channel *channel );
+// Reads a decimal integer from a channel
+int read_int( Channel *channel, int *value );
+// Reads a line from a channel
+size_t read_line( Channel *channel, char line[], size_t size );
+// Writes bytes to a channel
+void write_bytes( Channel *channel, const char bytes[], size_t length );
+// Writes a decimal integer line to a channel
+void write_int( Channel *channel, int value );
+// Writes a string line from memory to a channel
+void write_string( Channel *channel, Memory *mem, size_t address );
+// Writes formatted text to a channel
+void format_channel( Channel *channel, const char format[], ... ) PRINTF_FORMAT(2, 3);
+// Checks if input for a read has arrived
+int channel_ready( Channel *channel, int handler );
+// Initializes a machine
+void init_machine( Machine *vm, Channel *input, Channel *output );
+// Reads and assembles the jobs of a manifest
+int load_manifest( char manifestName[], Batch *batch, char **manifest, char *mnemonics[], WORD_TYPE opcodes[] );
+// Assembles many sources and directories on a thread pool
+int run_build( char *paths[], size_t numPaths, size_t numThreads, int optimize, int useCache, char *mnemonics[], WORD_TYPE opcodes[] );
+// Adds a source, or a directory's sources, to a build
+int add_sources( Build *build, size_t *capacity, char path[] );
+// Assembles build sources on a worker thread
+void *build_worker( void *arg );
+// Runs a batch manifest on a thread pool
+int run_batch( char manifestName[], size_t numThreads, char *mnemonics[], WORD_TYPE opcodes[] );
+// Runs batch jobs on a worker thread
+void *batch_worker( void *arg );
+// Takes a job from a worker queue
+int take_job( JobQueue *queue, int steal, size_t *jobIndex );
+// Runs one batch job
+int run_job( Job *job );
+// Runs a program on several cores sharing memory
+int execute_cores( Machine *vm, size_t numCores );
+// Runs a core until it stops
+void *run_core( void *arg );
+// Runs a bulk instruction on memory shared between cores
+int shared_bulk( Memory *mem, int handler, size_t params, WORD_TYPE *accumulator, size_t stored[2] );
+// Sleeps on a shared word
+void wait_word( Cluster *cluster, WORD_TYPE *word, WORD_TYPE value );
+// Wakes cores sleeping on shared words
+void wake_words( Cluster *cluster, size_t first, size_t count );
+// Prints per-core performance counters
+void print_cores( Cluster *cluster, double wallSeconds, FILE *report );
+// Runs a manifest's jobs as sessions on one thread
+int run_sessions( char manifestName[], size_t slice, char *mnemonics[], WORD_TYPE opcodes[] );
+// Opens a session's files and loads its program
+int open_session( Session *session, Job *job );
+// Closes a session's files
+int close_session( Session *session, int status );
+// Runs the benchmark suite
+int run_benchmarks( char reportName[], int useJit, char *mnemonics[], WORD_TYPE opcodes[] );
+// Runs one benchmark
+int run_benchmark( size_t benchmark, int useJit, char *mnemonics[], WORD_TYPE opcodes[], BenchResult *result );
+// Generates benchmark source and input
+size_t generate_benchmark( size_t benchmark, FILE *source, FILE *input );
+// Writes a benchmark report
+int write_report( char reportName[], const char *names[], BenchResult results[] );
+// Reads a monotonic clock
+double now_seconds( void );
+// Reads peak resident memory
+long int peak_rss( void );
+// Creates or opens a shared-memory live view
+LiveView *open_live( char name[] );
+// Unmaps a live view
+void close_live( LiveView *view );
+// Publishes a machine's registers and memory to a live view
+void publish_live( LiveView *view, Machine *vm, size_t ip, size_t instrCount );
+// Reads a consistent snapshot of a live view
+void read_live( const LiveView *view, LiveView *snapshot );
+// Prints a live view as formatted memory
+int view_live( char name[], FILE *report );
 
-    fseek(program, 0, SEEK_SET);    // Seek to program start
-    size_t lineNumber = 1;
-    size_t instructionAddress = 0;
-    char savedLabel[BUFFER_SIZE] = "\0"; // Buffer for label-only lines
-    size_t savedLabelLine;
 
-    // Read every program line
-    while (!feof(program)) {
-        fgets(buffer, sizeof(buffer), program);
 
-        int segNum = string_clean(buffer, segments);    // Clean instruction and determine format
-        if (BLK == segNum) {    // Skip empty lines
-            lineNumber++;
-            continue;
-        }
-        if (L__ == segNum) {    // If lone label
-            savedLabelLine = lineNumber;
-            strcpy(savedLabel, segments[0]); // Save label
-            lineNumber++;   // Continue until next instruction
-            continue;
-        }
-        if ('\0' != savedLabel[0] && '\0' == segments[0][0]) {
-            // If saved label exists and no current label, associate saved label with current instruction
-            strcpy(segments[0], savedLabel);
-            strcpy(savedLabel, "\0");
-        }
+#ifndef TIMS_LIBRARY
+int main(int argc, char *argv[]) {
+    // Initialize valid TIMS commands
+    char *commands[NUM_INSTR] = {"RDI", "RDS", "PRTI", "PRTS", "B", "BN", "BZ", "END",
+            "LOAD", "STORE", "ADD", "SUB", "BCPY", "BFIL", "BCMP", "BSCH", "BADD", "CAS", "FADD", "WAIT"};
+    WORD_TYPE codes[NUM_INSTR] = {RDI, RDS, PRTI, PRTS, B, BN, BZ, END,
+            LOAD, STORE, ADD, SUB, BCPY, BFIL, BCMP, BSCH, BADD, CAS, FADD, WAIT};
 
-        // If label found
-        if ('\0' != segments[0][0]) {
-            size_t reference = resolve_label(segments[0], header); // Attempt label resolve
+    // Initialize TIMS machine on the terminal, backed by the memory files
+    Channel input, output;
+    if (open_channel(&input, stdin) || open_channel(&output, stdout)) { return EXIT_FAILURE; }
+    Machine vm;
+    init_machine(&vm, &input, &output);
+    vm.persist = 1;
 
-            // If no reference
-            if (NO_LABEL == reference) {
-                // Create new node
-                Label *newNode = malloc(sizeof(Label));
-                if (NULL != newNode) {
-                    newNode->next = NULL;
-                    strcpy(newNode->name, segments[0]);
-                    newNode->address = instructionAddress++;
-                }
-                // Append node to list
-                if (NULL != prevNode) {
-                    prevNode->next = newNode;
-                    prevNode = newNode;
-                }
-                if (NULL == header) {   // Update header once
-                    header = newNode;
-                    prevNode = newNode;
-                }
+    char programNames[MAX_MODULES][PATH_SIZE];
+    char *modules[MAX_MODULES];     // Program, then object, file names
+    size_t numModules = 0;
+    size_t loadAddr = 0x0;
+    int useCache = 1;       // Reuse cached program images
+    int useJit = 0;         // Run as native code
+    int useOptimizer = 0;   // Optimize assembled programs
+    int useBuild = 0;       // Only assemble the sources and directories given
+    char **paths = calloc(argc, sizeof(char *));    // Sources and directories given
+    size_t numPaths = 0;
+    if (NULL == paths) { return EXIT_FAILURE; }
+    int useExtended = 0;    // Address extended memory
+    size_t numCores = 1;    // Cores sharing memory
+    char *manifestName = NULL;  // Batch manifest
+    char *sessionsName = NULL;  // Session manifest
+    size_t slice = SCHED_SLICE; // Instructions per session time slice
+    char *reportName = NULL;    // Benchmark report
+    char *foldedName = NULL;    // Profile folded stacks
+    Profile profile;
+    char *traceName = NULL;     // Execution trace
+    char *replayName = NULL;    // Trace to replay
+    char *translationName = NULL;   // C source translated to
+    char *snapshotName = NULL;  // Snapshot taken
+    size_t snapshotAt = 0;      // Instructions run before the snapshot (0 = at END)
+    char *resumeName = NULL;    // Snapshot resumed
+    char *debugName = NULL;     // Debugger commands
+    int useFusion = 0;          // Fuse hot sequences into superinstructions
+    char *sequencesName = NULL; // Sequence profile, written when profiling, else read to choose superinstructions
+    char *liveName = NULL;      // Shared-memory live view published
+    char *viewName = NULL;      // Shared-memory live view printed
+    Profile *sequences = NULL;
+    Debugger debugger;
+    Trace trace;
+#if defined(__unix__) && defined(_SC_NPROCESSORS_ONLN)
+    long int numThreads = sysconf(_SC_NPROCESSORS_ONLN);   // Batch worker threads
+#else
+    long int numThreads = DEFAULT_THREADS;
+#endif
+
+    for (size_t i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "la-", 3)) {
+            loadAddr = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "ck-", 3)) {
+            vm.checkpoint = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "sy-", 3)) {
+            vm.syncInterval = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "ca-", 3)) {
+            useCache = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "jit-", 4)) {
+            useJit = strtol(&argv[i][4], NULL, 10);
+        } else if (!strncmp(argv[i], "as-", 3)) {
+            useBuild = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "op-", 3)) {
+            useOptimizer = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "co-", 3)) {
+            numCores = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "ex-", 3)) {
+            useExtended = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "batch-", 6)) {
+            manifestName = &argv[i][6];
+        } else if (!strncmp(argv[i], "sched-", 6)) {
+            sessionsName = &argv[i][6];
+        } else if (!strncmp(argv[i], "sl-", 3)) {
+            slice = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "bench-", 6)) {
+            reportName = &argv[i][6];
+        } else if (!strncmp(argv[i], "pr-", 3)) {
+            foldedName = &argv[i][3];
+        } else if (!strncmp(argv[i], "tr-", 3)) {
+            traceName = &argv[i][3];
+        } else if (!strncmp(argv[i], "replay-", 7)) {
+            replayName = &argv[i][7];
+        } else if (!strncmp(argv[i], "aot-", 4)) {
+            translationName = &argv[i][4];
+        } else if (!strncmp(argv[i], "snap-", 5)) {
+            snapshotName = &argv[i][5];
+        } else if (!strncmp(argv[i], "at-", 3)) {
+            snapshotAt = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "resume-", 7)) {
+            resumeName = &argv[i][7];
+        } else if (!strncmp(argv[i], "fu-", 3)) {
+            useFusion = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "seq-", 4)) {
+            sequencesName = &argv[i][4];
+        } else if (!strncmp(argv[i], "shm-", 4)) {
+            liveName = &argv[i][4];
+        } else if (!strncmp(argv[i], "view-", 5)) {
+            viewName = &argv[i][5];
+        } else if (!strncmp(argv[i], "dbg-", 4)) {
+            debugName = &argv[i][4];
+        } else if (!strncmp(argv[i], "th-", 3)) {
+            numThreads = strtol(&argv[i][3], NULL, 10);
+        } else if (!strncmp(argv[i], "in-", 3)) {     // Program input from a file or pipe
+            input.file = fopen(&argv[i][3], "rb");
+            if (NULL == input.file) { return EXIT_FAILURE; }
+        } else if (!strncmp(argv[i], "out-", 4)) {    // Program output to a file or pipe
+            output.file = fopen(&argv[i][4], "wb");
+            if (NULL == output.file) { return EXIT_FAILURE; }
+        } else {
+            paths[numPaths++] = argv[i];
+            if (numModules < MAX_MODULES && strlen(argv[i]) + 3 < PATH_SIZE) {
+                modules[numModules] = strcpy(programNames[numModules], argv[i]);
+                numModules++;
             }
         }
-
-        lineNumber++;   // Next line
     }
 
-    if (strcmp("\0", savedLabel)) { // Warning for dangling labels
-        printf("Warning: Line %u - dangling label \"%s\" ignored\n", savedLabelLine, savedLabel);
+    // Builds only assemble, leaving the memory files alone
+    if (useBuild) {
+        return run_build(paths, numPaths, numThreads > 0 ? numThreads : DEFAULT_THREADS, useOptimizer, useCache, commands, codes) ? EXIT_FAILURE : EXIT_SUCCESS;
     }
 
-    fseek(program, 0, SEEK_SET);    // Return seek to file beginning     
+    // Batch jobs run on private machines and leave the memory files alone
+    if (NULL != manifestName) {
+        return run_batch(manifestName, numThreads > 0 ? numThreads : DEFAULT_THREADS, commands, codes) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (NULL != sessionsName) {
+        return run_sessions(sessionsName, slice ? slice : SCHED_SLICE, commands, codes) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    // As do benchmarks
+    if (NULL != reportName) {
+        return run_benchmarks(reportName, useJit, commands, codes) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    // Replays need no program or input
+    if (NULL != replayName) {
+        return replay_trace(replayName, &output) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    // Nor do views of a running machine
+    if (NULL != viewName) {
+        if (view_live(viewName, stdout)) {
+            printf("Failed to view \"%s\"\n", viewName);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
 
-    return header;  // Return linked list header
-}
+    // Traces and translations cover base memory only
+    if (useExtended && (NULL != traceName || NULL != translationName)) {
+        puts("Extended memory can't be traced or translated");
+        return EXIT_FAILURE;
+    }
+    // Cores run on the interpreter alone
+    if (numCores > 1 && (NULL != traceName || NULL != foldedName || useExtended || numCores > MAX_CORES)) {
+        printf("Multiple cores can't be traced, profiled or use extended memory, and number at most %u\n", MAX_CORES);
+        return EXIT_FAILURE;
+    }
+    // Live views publish one core's registers
+    if (NULL != liveName && numCores > 1) {
+        puts("Multiple cores can't publish a live view");
+        return EXIT_FAILURE;
+    }
+    // Snapshots hold one core's registers
+    if ((NULL != snapshotName || NULL != resumeName) && (numCores > 1 || NULL != translationName)) {
+        puts("Snapshots can't be taken or resumed on multiple cores or translated");
+        return EXIT_FAILURE;
+    }
+    // The debugger drives one core on the interpreter alone
+    if (NULL != debugName && (numCores > 1 || NULL != translationName || NULL != snapshotName || NULL != traceName || NULL != foldedName)) {
+        puts("Programs can't be debugged on multiple cores, traced, profiled, translated or snapshotted");
+        return EXIT_FAILURE;
+    }
+    if (NULL != debugName) {
+        memset(&debugger, 0, sizeof(Debugger));
+        debugger.commands = fopen(debugName, "r");
+        if (NULL == debugger.commands) { return EXIT_FAILURE; }
+    }
 
+    if (NULL == translationName) {   // Translations leave the memory files alone
+        clear_mem();
+    }
+    if (useExtended && init_pages(&vm.mem)) { return EXIT_FAILURE; }
 
+#ifdef SIGUSR1
+    signal(SIGUSR1, request_memf_refresh);  // Allow refreshing memf on request
+#endif
+#ifdef SIGUSR2
+    signal(SIGUSR2, request_trace);         // Allow writing the trace on request
+#endif
 
-// Returns the program address of a known label reference
-size_t resolve_label( char reference[], Label *header ) {
-    Label *node = header;
-    // Search every list node
-    while (NULL != node) {
-        if (!strcmp(node->name, reference)) {
-            return node->address;   // Return label address
+    vm.instrPtr = loadAddr;
+    if (NULL != foldedName) {   // Profile execution
+        memset(&profile, 0, sizeof(Profile));
+        vm.profile = &profile;
+    }
+    if (NULL != traceName) {    // Trace execution
+        if (open_trace(&trace, traceName)) { return EXIT_FAILURE; }
+        vm.trace = &trace;
+    }
+    if (NULL != liveName) {     // Publish registers and memory for monitors
+        vm.live = open_live(liveName);
+        if (NULL == vm.live) {
+            printf("Failed to open live view \"%s\"\n\n", liveName);
+            return EXIT_FAILURE;
         }
-        node = node->next;
     }
-    return NO_LABEL;    // No matching label
-}
-
-
-
-// Returns the TIMS opcode of the given mnemonic string
-int get_opcode( char mnemonic[], char *mnemonics[], WORD_TYPE opcodes[] ) {
-    // Search opcode
-    for (size_t i = 0; i < NUM_INSTR; i++) {
-        // If match return opcode
-        if (!strcmp(mnemonics[i], mnemonic)) {
-            return opcodes[i];
+    if (useFusion && NULL != sequencesName && NULL == foldedName) {   // Choose superinstructions from a saved profile
+        sequences = calloc(1, sizeof(Profile));
+        if (NULL == sequences || read_sequences(sequences, sequencesName)) {
+            printf("Failed to read sequence profile \"%s\"\n\n", sequencesName);
+            return EXIT_FAILURE;
         }
     }
-    return NO_OPCODE ; // Else no match
-}
 
-
-
-// Cleans a TIMS instruction into its instruction components
-// Returns instruction format of string
-// Any substring will be returned in instr[]
-int string_clean( char instr[], char destArray[][BUFFER_SIZE] ) {
-    // If opening quotes
-    if (strcspn(instr, "\"") < strlen(instr)) {
-        char *string = strpbrk(instr, "\"");    // Save string pointer
-        string++;
-        // If label before quotes
-        if (strcspn(instr, ":") < strcspn(instr, "\"")) {
-            char *label = strtok(instr, ":");   // Separate label
-            label = strtok(label, " "); // Clean label
-            strcpy(destArray[0], label);    // Store label
-        } else {    // Else set label element to null
-            strcpy(destArray[0], "\0");
-        }
-        // If Closing quotes
-        if (strcspn(string, "\"") < strlen(string)) {
-            string = strtok(string, "\"");  // Separate string contents
-            strcpy(instr, string);  // Return string contents in instr[]
-            return _S_; // Return format
-        } else {    // Else invalid string
-            return INV_STR;
+    // Resume a snapshot, else run straight from the cached image when the sources are unchanged
+    unsigned long long sourceHash = 0;
+    int numWords = NO_IMAGE;
+    if (NULL != resumeName) {
+        numWords = load_snapshot(&vm, resumeName);
+        if (numWords) {
+            printf("\nFailed to resume snapshot \"%s\"\n\n", resumeName);
+            return EXIT_FAILURE;
         }
+        printf("\nResumed snapshot \"%s\" at word %zu after %zu instructions\n\n", resumeName, vm.instrPtr, vm.instrCount);
+    } else {
+        sourceHash = useCache ? hash_program(modules, numModules, useOptimizer) : 0;
+        numWords = sourceHash ? load_image(sourceHash, loadAddr, &vm.mem, &vm.instrPtr) : NO_IMAGE;
     }
 
-    // Determine if label exists
-    unsigned int strLen = strlen(instr);
-    char *token = strtok(instr, ":");
+    // Else assemble every module, then link them from the load address
+    if (NO_IMAGE == numWords) {
+        int assemblyStatus = numModules ? 0 : PROG_ACC_ERR;
+        for (size_t m = 0; m < numModules; m++) {
+            assemblyStatus |= assemble_program(modules[m], commands, codes, useOptimizer, stdout);
+        }
+        if (assemblyStatus) { return 0; }
 
-    // If label
-    if (strlen(token) < strLen) {
-        char *label = token;    // Separate label
-        token = strtok(NULL, ":");  // Get remaining components
-        label = strtok(label, " "); // Clean label
-        strcpy(destArray[0], label); // Store label
-    } else {    // Else set label element to null
-        strcpy(destArray[0], "\0");
+        numWords = link_program(modules, numModules, loadAddr, &vm.mem, stdout);
+        if (numWords < 0) { return 0; }
+        if (sourceHash) {
+            cache_image(sourceHash, loadAddr, numWords, &vm.mem);
+        }
     }
 
-    // Separate remaining components
-    unsigned int componentNum = 0;
-    if (NULL != token) {
-        token = strtok(token, " ");
+    // Translate instead of running
+    if (NULL != translationName) {
+        return translate_program(translationName, &vm.mem, vm.instrPtr) ? EXIT_FAILURE : EXIT_SUCCESS;
     }
 
-    while (NULL != token) {
-        if (!isgraph(token[0])) { break; }  // Ignore non-graphable components
+    // Store loaded program in the memory files
+    if (write_mem(&vm.mem) || sync_memf(&vm.mem)) { return 0; }
 
-        // Remove trailing non-graphical characters
-        for (size_t i = strlen(token) - 1; i >= 0; i--) {
-            if (!isgraph(token[i])) {
-                token[i] = '\0';
-            } else { break; }
-        }
+    puts("\n_____Executing TIMS Program_____\n");
+    vm.instrLimit = NULL == snapshotName ? 0 : snapshotAt;
+    int status = NULL != debugName ? debug_machine(&vm, &debugger)
+            : numCores > 1 ? execute_cores(&vm, numCores) : useJit ? execute_jit(&vm)
+            : useFusion && NULL == vm.profile ? execute_fused(&vm, sequences) : execute(&vm);
 
-        for (size_t i = 0; i < strlen(token); i++) {    // Convert to uppercase
-            token[i] = toupper(token[i]);
+    // Snapshot at the instruction limit, then run on, or at END
+    if (NULL != snapshotName && (!status || INSTR_LIMIT == status)) {
+        if (save_snapshot(&vm, snapshotName)) {
+            printf("\nFailed to write snapshot \"%s\"\n\n", snapshotName);
+        } else {
+            printf("\nSnapshot \"%s\" taken at word %zu after %zu instructions\n\n", snapshotName, vm.instrPtr, vm.instrCount);
+        }
+        if (INSTR_LIMIT == status) {
+            vm.instrLimit = 0;
+            status = useJit ? execute_jit(&vm) : execute(&vm);
         }
-
-        strcpy(destArray[++componentNum], token);   // Store component
-        token = strtok(NULL, " ");  // Get next component
     }
-
-    // Determine instruction format
-    switch (componentNum) {
-        case 0:
-            if ('\0' != destArray[0][0]) {
-                return L__; // Label only
-            } else {
-                return BLK; // Blank line
-            }
-        case 1:
-            if (isdigit(destArray[1][0])) {
-                return _D_; // Data word
-            } else {
-                return _I_; // No-operand instruction
-            }
-        case 2:
-            if (isdigit(destArray[2][0])) {
-                return _IL_;    // Instruction with operand literal
-            } else {
-                return _IR_;    // Instruction with reference operand
+    if (NULL != vm.profile) {
+        print_profile(vm.profile, stdout);
+        if (write_folded(vm.profile, foldedName)) {
+            printf("Failed to write profile \"%s\"\n\n", foldedName);
+        }
+        if (NULL != sequencesName && write_sequences(vm.profile, sequencesName)) {
+            printf("Failed to write sequence profile \"%s\"\n\n", sequencesName);
+        }
+    }
+    if (vm.fusions) {
+        fputs("\nSuperinstructions:", stdout);
+        for (size_t f = 0; f < NUM_FUSIONS; f++) {
+            if (vm.fusions & 1u << f) {
+                printf(" %s", handler_name(fusionCatalog[f].handler));
             }
-        default:
-            return INV_INSTR;   // Unrecognized instruction format
+        }
+        printf("\n%zu of %zu instructions ran without a dispatch of their own\n", vm.fusedCount, vm.instrCount);
     }
+    free(sequences);
+    close_live(vm.live);
+    if (!status) {
+        puts("\n_____TIMS Execution Complete_____\n");
+        dump(&vm);
+    }
+
+    return 0;
 }
+#endif
 
 
 
 // ______________________________
-//             MEMORY
+//           EXECUTION
 // ______________________________
 
 
 
-// Loads a program to TIMS memory
-int load_program( char programName[], size_t address ) {
-    FILE *program = fopen(programName, "r");    // Open program
-    if (NULL == program) { return PROG_ACC_ERR; }
-
-    FILE *memory = fopen(MEMORY, "r+"); // Open memory
-    if (NULL == memory) { return MEM_ACC_ERR; }
+// Dispatch through label addresses where supported, else through a switch
+#ifdef THREADED_DISPATCH
+#define HANDLER(handler) do_##handler
+#define DISPATCH() goto *cache[ip].label
+#define DISPATCH_FROM(index) goto *cache[index].label
+#define ENTRY(instr) (instr).label
+#else
+#define HANDLER(handler) case handler
+#define DISPATCH() goto dispatch
+#define DISPATCH_FROM(index) handler = cache[index].entry; goto select
+#define ENTRY(instr) (instr).entry
+#endif
 
-    WORD_TYPE buffer = 0x0; // Instruction transfer buffer
+// Instruction pointers in extended memory dispatch through the end-of-memory sentinel
+#define CACHE_INDEX(address) ((address) < NUM_MEM_WORDS ? (address) : NUM_MEM_WORDS)
 
-    fseek(memory, address * sizeof(WORD_TYPE), SEEK_SET);   // Seek to given memory word address 
+// Force re-decoding of a word after a store
+#define INVALIDATE_INSTR(address) cache[address].handler = H_DECODE; ENTRY(cache[address]) = entries[H_DECODE]
 
-    // Load program instructions to memory
-    fread(&buffer, sizeof(WORD_TYPE), 1, program);
-    while (!feof(program)) {
-        switch (buffer / 0x100) {   // Correct any memory addressing with the program load address
-            case RDI:
-            case RDS:
-            case PRTI:
-            case PRTS:
-            case B:
-            case BN:
-            case BZ:
-                buffer += (WORD_TYPE) address;
-        }
-        
-        fwrite(&buffer, sizeof(WORD_TYPE), 1, memory);
-        fread(&buffer, sizeof(WORD_TYPE), 1, program);
-    }
+// Advance to the next instruction, polling checkpoints and syncs when due
+#define NEXT_INSTR(next) ip = (next); if (++instrCount == nextPoll) { goto poll; } DISPATCH()
 
-    if (fclose(program)) { return PROG_ACC_ERR; }
-    int syncReturn = sync_memf(memory);  // Sync MEMF and close MEM
+// Run on into the next word of a superinstruction, polling when due, unless a store or breakpoint
+// has changed it from the fused handler, leaving it to its own dispatch
+#define FUSED_NEXT(next) ip++; if (++instrCount == nextPoll) { goto poll; } if ((next) != cache[ip].handler) { DISPATCH(); } numFused++
 
-    printf("\nLoaded \"%s\" to TIMS memory word %u\n\n", programName, address);
+// Store the accumulator to the operand of the instruction at the instruction pointer
+#define STORE_ACCUMULATOR() instr = &cache[ip]; mem->words[instr->operand] = vm->accumulator; mark_dirty(mem, instr->operand); INVALIDATE_INSTR(instr->operand)
 
-    return syncReturn;
+// Executes TIMS program from the word address in the machine's instruction pointer
+int execute( Machine *vm ) {
+    return interpret(vm, 0);
 }
 
 
 
-// Synchronizes the formatted memory file to the functional memory file
-int sync_memf( FILE *memory ) {
-    long int memOffset = 0x0;  // Memory offset if open file passed
+// Interprets TIMS program from the word address in the machine's instruction pointer,
+// counting on from the instructions already run by execute_jit() when it hands over
+// Stops after the machine's instruction limit, if any, ready to resume
+// Profiling and tracing machines dispatch every instruction through a hook, others run unchanged
+// Debugged machines decode breakpoints to a trap and stores to the extended path, so other instructions run unchanged
+// Unhooked machines with superinstructions dispatch hot sequences once, from their first word
+int interpret( Machine *vm, size_t instrCount ) {
+    Memory *mem = &vm->mem;     // RAM memory image
 
-    if (NULL == memory) {   // Ensure memory open
-        memory = fopen(MEMORY, "r");
-        if (NULL == memory) { return MEM_ACC_ERR; }
-    } else {
-        memOffset = ftell(memory);  // Save previous file offset
-    }
+    char *memBytes = (char *) mem->words;   // Byte view of memory for string I/O
+    char *ioStr = NULL;             // I/O string in memory
+    size_t ioStrLen = 0;            // I/O string length
 
-    fseek(memory, 0 ,SEEK_SET);     // Seek to first memory word
-    
-    WORD_TYPE buffer[NUM_MEM_WORDS] = {0x0};    // Initialize memory transfer buffer
+    size_t ip = vm->instrPtr;   // Working instruction pointer
+    size_t nextPoll = 0;        // Instruction count of next checkpoint/sync poll
+    int status = 0;
 
-    // Read TIMS memory contents
-    if (NUM_MEM_WORDS != fread(buffer, sizeof(WORD_TYPE), NUM_MEM_WORDS, memory)) {
-        return MEM_ACC_ERR;
-    }
+    Decoded cache[NUM_MEM_WORDS + 1];   // Pre-decoded memory plus end-of-memory sentinel
+    Decoded *instr = NULL;              // Executing instruction
+    size_t stored[2] = {0, 0};          // Base words stored to on the extended path
+    size_t numFused = 0;                // Instructions run inside superinstructions
 
-    if (!memOffset) {   // Close memory if was previously closed
-        if (fclose(memory)) { return MEM_ACC_ERR; }
-    } else {
-        fseek(memory, memOffset, SEEK_SET); // Else return to previous offset
-    }
+    Profile *profile = vm->profile;
+    Trace *trace = vm->trace;
+    double startSeconds = NULL == profile ? 0 : now_seconds();
 
-    FILE *memf = fopen(FORMATTED_MEMORY, "r+"); // Open formatted memory file
-    if (NULL == memf) { return MEMF_ACC_ERR; }
+    // Dispatched entry of each handler, the counting stub when profiling
+#ifdef THREADED_DISPATCH
+    static void *const handlerLabels[NUM_HANDLERS] = {
+        [H_RDI] = &&do_H_RDI, [H_RDS] = &&do_H_RDS, [H_PRTI] = &&do_H_PRTI, [H_PRTS] = &&do_H_PRTS,
+        [H_B] = &&do_H_B, [H_BN] = &&do_H_BN, [H_BZ] = &&do_H_BZ, [H_END] = &&do_H_END,
+        [H_NOP] = &&do_H_NOP, [H_BAD_ADDR] = &&do_H_BAD_ADDR, [H_DECODE] = &&do_H_DECODE,
+        [H_HOOK] = &&do_H_HOOK, [H_EXTENDED] = &&do_H_EXTENDED,
+        [H_LOAD] = &&do_H_LOAD, [H_STORE] = &&do_H_STORE, [H_ADD] = &&do_H_ADD, [H_SUB] = &&do_H_SUB,
+        [H_BCPY] = &&do_H_BCPY, [H_BFIL] = &&do_H_BFIL, [H_BCMP] = &&do_H_BCMP, [H_BSCH] = &&do_H_BSCH,
+        [H_BADD] = &&do_H_BADD, [H_CAS] = &&do_H_CAS, [H_FADD] = &&do_H_FADD, [H_WAIT] = &&do_H_WAIT,
+        [H_BREAK] = &&do_H_BREAK, [H_LOAD_ADD_STORE] = &&do_H_LOAD_ADD_STORE, [H_LOAD_SUB_STORE] = &&do_H_LOAD_SUB_STORE,
+        [H_LOAD_ADD] = &&do_H_LOAD_ADD, [H_LOAD_SUB] = &&do_H_LOAD_SUB, [H_ADD_STORE] = &&do_H_ADD_STORE,
+        [H_SUB_STORE] = &&do_H_SUB_STORE, [H_LOAD_BZ] = &&do_H_LOAD_BZ, [H_LOAD_BN] = &&do_H_LOAD_BN,
+        [H_BZ_BN] = &&do_H_BZ_BN, [H_PRTI_B] = &&do_H_PRTI_B, [H_PRTS_B] = &&do_H_PRTS_B, [H_STORE_B] = &&do_H_STORE_B
+    };
+    static void *const hookLabels[NUM_HANDLERS] = {
+        &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK,
+        &&do_H_HOOK, &&do_H_HOOK, &&do_H_DECODE, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK,
+        &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK,
+        &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK,
+        &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK, &&do_H_HOOK
+    };
+    void *const *entries = NULL == profile && NULL == trace ? handlerLabels : hookLabels;
+#else
+    static const int handlerEntries[NUM_HANDLERS] = {
+        H_RDI, H_RDS, H_PRTI, H_PRTS, H_B, H_BN, H_BZ, H_END, H_NOP, H_BAD_ADDR, H_DECODE, H_HOOK,
+        H_EXTENDED, H_LOAD, H_STORE, H_ADD, H_SUB, H_BCPY, H_BFIL, H_BCMP, H_BSCH, H_BADD,
+        H_CAS, H_FADD, H_WAIT, H_BREAK, H_LOAD_ADD_STORE, H_LOAD_SUB_STORE, H_LOAD_ADD, H_LOAD_SUB,
+        H_ADD_STORE, H_SUB_STORE, H_LOAD_BZ, H_LOAD_BN, H_BZ_BN, H_PRTI_B, H_PRTS_B, H_STORE_B
+    };
+    static const int hookEntries[NUM_HANDLERS] = {
+        H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK,
+        H_HOOK, H_HOOK, H_DECODE, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK,
+        H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK,
+        H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK,
+        H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK, H_HOOK
+    };
+    const int *entries = NULL == profile && NULL == trace ? handlerEntries : hookEntries;
+    int handler = 0;    // Handler being dispatched
+#endif
+
+    // Stop outside of memory as any running instruction would, resuming in extended memory through the sentinel
+    if (ip >= NUM_MEM_WORDS && NULL == mem->pages) {
+        status = INV_ADDR;
+        goto halt;
+    }
 
-    // Write formatted contents
-    fprintf(memf, "           0         1         2         3         4         5         6         7         8         9\n");
+    // Pre-decode memory image
     for (size_t word = 0; word < NUM_MEM_WORDS; word++) {
-        if (!(word % 10)) {
-            fprintf(memf, "%3u", word);
-        }
-        fprintf(memf, "   0x%04x%c", buffer[word], (word + 1) % 10 ? ' ' : '\n');
+        decode_instr(mem, word, &cache[word], vm->debugger);
+    }
+    cache[NUM_MEM_WORDS].handler = NULL == mem->pages ? H_BAD_ADDR : H_EXTENDED;    // Running off the end of base memory
+    for (size_t word = 0; word <= NUM_MEM_WORDS; word++) {
+        ENTRY(cache[word]) = entries[cache[word].handler];
+    }
+    // Fuse sequences into superinstructions at their first words, the rest still dispatching alone for branches into them
+    for (size_t word = 0; vm->fusions && NULL == profile && NULL == trace && word < NUM_MEM_WORDS; word++) {
+        ENTRY(cache[word]) = entries[fuse_instr(cache, word, vm->fusions)];
     }
 
-    if (fclose(memf)) { return MEMF_ACC_ERR; }  // Close memf
-    
-    return 0;
-}
+    goto poll;  // Schedule first poll and dispatch first instruction
 
+    // Execute entire program
+#ifndef THREADED_DISPATCH
+dispatch:
+    handler = cache[ip].entry;
+select:
+    switch (handler) {
+#endif
+        // I/O
+        HANDLER(H_RDI):     // Read integer from input to memory
+            instr = &cache[ip];
+            if (vm->input->nonblocking && !channel_ready(vm->input, H_RDI)) {
+                status = INPUT_WAIT;    // Resumes at the read
+                goto halt;
+            }
+            read_int(vm->input, &vm->ioIntBuff);    // Keeps last value if none read
+            mem->words[instr->operand] = (WORD_TYPE) vm->ioIntBuff;
+            mark_dirty(mem, instr->operand);
+            INVALIDATE_INSTR(instr->operand);
+            if (NULL != trace) {
+                trace_write(trace, mem, instr->operand);
+            }
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_RDS):     // Read string line from input to memory
+            instr = &cache[ip];
+            if (vm->input->nonblocking && !channel_ready(vm->input, H_RDS)) {
+                status = INPUT_WAIT;
+                goto halt;
+            }
+            ioStr = &memBytes[instr->operand * sizeof(WORD_TYPE)];
+            ioStrLen = read_line(vm->input, ioStr, sizeof(mem->words) - instr->operand * sizeof(WORD_TYPE));  // Truncate at end of memory
+            for (size_t word = instr->operand; (word - instr->operand) * sizeof(WORD_TYPE) < ioStrLen; word++) {
+                mark_dirty(mem, word);
+                INVALIDATE_INSTR(word);
+                if (NULL != trace) {
+                    trace_write(trace, mem, word);
+                }
+            }
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_PRTI):    // Print integer from memory
+            write_int(vm->output, mem->words[cache[ip].operand]);
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_PRTS):    // Print string from memory
+            write_string(vm->output, mem, cache[ip].operand);
+            NEXT_INSTR(ip + 1);
 
+        // Branches
+        HANDLER(H_B):       // Unconditional branch
+            NEXT_INSTR(cache[ip].target);
+        HANDLER(H_BN):      // Branch if accumulator negative
+            NEXT_INSTR(vm->accumulator < 0 ? cache[ip].target : ip + 1);
+        HANDLER(H_BZ):      // Branch if accumulator zero
+            NEXT_INSTR(!vm->accumulator ? cache[ip].target : ip + 1);
 
-// Clears TIMS memory
-int clear_mem( void ) {
-    FILE *memory = fopen(MEMORY, "r+"); // Open memory file
-    if (NULL == memory) { return MEM_ACC_ERR; }
+        // Accumulator
+        HANDLER(H_LOAD):    // Load accumulator from memory
+            vm->accumulator = mem->words[cache[ip].operand];
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_STORE):   // Store accumulator to memory
+            instr = &cache[ip];
+            mem->words[instr->operand] = vm->accumulator;
+            mark_dirty(mem, instr->operand);
+            INVALIDATE_INSTR(instr->operand);
+            if (NULL != trace) {
+                trace_write(trace, mem, instr->operand);
+            }
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_ADD):     // Add memory to accumulator
+            vm->accumulator = (WORD_TYPE) (vm->accumulator + mem->words[cache[ip].operand]);
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_SUB):     // Subtract memory from accumulator
+            vm->accumulator = (WORD_TYPE) (vm->accumulator - mem->words[cache[ip].operand]);
+            NEXT_INSTR(ip + 1);
+
+        // Bulk memory
+        HANDLER(H_BCPY):
+        HANDLER(H_BFIL):
+        HANDLER(H_BCMP):
+        HANDLER(H_BSCH):
+        HANDLER(H_BADD):    // Run over the parameter block, one dispatch for the whole range
+            instr = &cache[ip];
+            status = execute_bulk(mem, instr->handler, instr->operand, &vm->accumulator, stored);
+            if (status) { goto halt; }
+            for (size_t word = stored[0]; word < stored[1]; word++) {
+                INVALIDATE_INSTR(word);
+                if (NULL != trace) {
+                    trace_write(trace, mem, word);
+                }
+            }
+            NEXT_INSTR(ip + 1);
+
+        // Atomics, plain on a single core
+        HANDLER(H_CAS):
+        HANDLER(H_FADD):    // Run, leaving the word's old value in the accumulator
+            instr = &cache[ip];
+            if (execute_atomic(mem, instr->handler, instr->operand, &vm->accumulator)) {
+                INVALIDATE_INSTR(instr->operand);
+                if (NULL != trace) {
+                    trace_write(trace, mem, instr->operand);
+                }
+            }
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_WAIT):    // Nothing else can store to memory, so never sleeps
+            NEXT_INSTR(ip + 1);
+
+        // Superinstructions, each running its sequence on one dispatch
+        HANDLER(H_LOAD_ADD_STORE):
+            vm->accumulator = mem->words[cache[ip].operand];
+            FUSED_NEXT(H_ADD);
+            vm->accumulator = (WORD_TYPE) (vm->accumulator + mem->words[cache[ip].operand]);
+            FUSED_NEXT(H_STORE);
+            STORE_ACCUMULATOR();
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_LOAD_SUB_STORE):
+            vm->accumulator = mem->words[cache[ip].operand];
+            FUSED_NEXT(H_SUB);
+            vm->accumulator = (WORD_TYPE) (vm->accumulator - mem->words[cache[ip].operand]);
+            FUSED_NEXT(H_STORE);
+            STORE_ACCUMULATOR();
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_LOAD_ADD):
+            vm->accumulator = mem->words[cache[ip].operand];
+            FUSED_NEXT(H_ADD);
+            vm->accumulator = (WORD_TYPE) (vm->accumulator + mem->words[cache[ip].operand]);
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_LOAD_SUB):
+            vm->accumulator = mem->words[cache[ip].operand];
+            FUSED_NEXT(H_SUB);
+            vm->accumulator = (WORD_TYPE) (vm->accumulator - mem->words[cache[ip].operand]);
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_ADD_STORE):
+            vm->accumulator = (WORD_TYPE) (vm->accumulator + mem->words[cache[ip].operand]);
+            FUSED_NEXT(H_STORE);
+            STORE_ACCUMULATOR();
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_SUB_STORE):
+            vm->accumulator = (WORD_TYPE) (vm->accumulator - mem->words[cache[ip].operand]);
+            FUSED_NEXT(H_STORE);
+            STORE_ACCUMULATOR();
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_LOAD_BZ):
+            vm->accumulator = mem->words[cache[ip].operand];
+            FUSED_NEXT(H_BZ);
+            NEXT_INSTR(!vm->accumulator ? cache[ip].target : ip + 1);
+        HANDLER(H_LOAD_BN):
+            vm->accumulator = mem->words[cache[ip].operand];
+            FUSED_NEXT(H_BN);
+            NEXT_INSTR(vm->accumulator < 0 ? cache[ip].target : ip + 1);
+        HANDLER(H_BZ_BN):   // Zero, negative or on, testing the accumulator once
+            if (!vm->accumulator) {
+                NEXT_INSTR(cache[ip].target);
+            }
+            FUSED_NEXT(H_BN);
+            NEXT_INSTR(vm->accumulator < 0 ? cache[ip].target : ip + 1);
+        HANDLER(H_PRTI_B):
+            write_int(vm->output, mem->words[cache[ip].operand]);
+            FUSED_NEXT(H_B);
+            NEXT_INSTR(cache[ip].target);
+        HANDLER(H_PRTS_B):
+            write_string(vm->output, mem, cache[ip].operand);
+            FUSED_NEXT(H_B);
+            NEXT_INSTR(cache[ip].target);
+        HANDLER(H_STORE_B):
+            STORE_ACCUMULATOR();
+            FUSED_NEXT(H_B);
+            NEXT_INSTR(cache[ip].target);
+
+        HANDLER(H_NOP):     // Unrecognized opcodes have no effect
+            NEXT_INSTR(ip + 1);
+        HANDLER(H_DECODE):  // Re-decode a word invalidated by a store
+            decode_instr(mem, ip, &cache[ip], vm->debugger);
+            ENTRY(cache[ip]) = entries[cache[ip].handler];
+            DISPATCH();
+        HANDLER(H_HOOK):    // Profile or trace instruction, then run its handler
+            instr = &cache[CACHE_INDEX(ip)];
+            if (NULL != profile) {
+                profile_instr(profile, CACHE_INDEX(ip), instr->handler, vm->accumulator);
+            }
+            if (NULL != trace) {
+                trace_instr(trace, mem, ip, ip < NUM_MEM_WORDS ? mem->words[ip] : 0, vm->accumulator);
+            }
+#ifdef THREADED_DISPATCH
+            goto *handlerLabels[instr->handler];
+#else
+            handler = instr->handler;
+            goto select;
+#endif
+        HANDLER(H_EXTENDED):    // Decode and execute straight from memory
+            status = step_extended(vm, &ip, stored);
+            for (size_t word = stored[0]; word < stored[1]; word++) {
+                INVALIDATE_INSTR(word);
+            }
+            if (H_END == status || H_BAD_ADDR == status || status < 0) {
+                instrCount += WATCHPOINT == status;     // Stopped after the store
+                status = H_END == status ? 0 : H_BAD_ADDR == status ? INV_ADDR : status;
+                goto halt;
+            }
+            status = 0;
+            if (++instrCount == nextPoll) { goto poll; }
+            DISPATCH_FROM(CACHE_INDEX(ip));
+        HANDLER(H_BAD_ADDR):    // Operand or fetch outside of TIMS memory
+            status = INV_ADDR;
+            goto halt;
+        HANDLER(H_BREAK):   // Stop before the instruction under a breakpoint
+            status = BREAKPOINT;
+            goto halt;
+        HANDLER(H_END):
+            goto halt;
+#ifndef THREADED_DISPATCH
+    }
+#endif
+
+poll:
+    nextPoll = poll_machine(vm, ip, instrCount, &status);
+    if (status) { goto halt; }
+    DISPATCH_FROM(CACHE_INDEX(ip));
+
+halt:
+    vm->fusedCount += numFused;
+    if (NULL != profile) {
+        if (profile->ioStart) {     // Last instruction was I/O
+            profile->ioSeconds += now_seconds() - profile->ioStart;
+            profile->ioStart = 0;
+        }
+        profile->totalSeconds += now_seconds() - startSeconds;
+    }
+
+    return stop_machine(vm, ip, instrCount, status);
+}
+
+#undef HANDLER
+#undef DISPATCH
+#undef DISPATCH_FROM
+#undef CACHE_INDEX
+#undef ENTRY
+#undef NEXT_INSTR
+#undef INVALIDATE_INSTR
+#undef FUSED_NEXT
+#undef STORE_ACCUMULATOR
+
+
+
+// Runs the work due every so many instructions and returns the instruction count of the next poll
+// Persistent machines write memory back every checkpoint instructions, and sync formatted memory
+// every syncInterval instructions and on SIGUSR1
+// Machines with a live view publish to it every poll instead, polling at least every syncInterval instructions
+// Sets status on error or at the instruction limit
+size_t poll_machine( Machine *vm, size_t ip, size_t instrCount, int *status ) {
+    size_t checkpoint = vm->persist ? vm->checkpoint : 0;
+    size_t syncInterval = vm->persist || NULL != vm->live ? vm->syncInterval : 0;
+
+    // Write back memory at checkpoints
+    if (checkpoint && instrCount && !(instrCount % checkpoint)) {
+        if (write_mem(&vm->mem)) {
+            *status = MEM_ACC_ERR;
+            return instrCount;
+        }
+    }
+    // Sync formatted memory at intervals or on request, or publish to the live view in place of interval syncs
+    if (NULL != vm->live) {
+        publish_live(vm->live, vm, ip, instrCount);
+    }
+    if (vm->persist && (memfRefresh || (NULL == vm->live && syncInterval && instrCount && !(instrCount % syncInterval)))) {
+        memfRefresh = 0;
+        sync_memf(&vm->mem);
+    }
+    // Write trace on request
+    if (NULL != vm->trace && traceRequest) {
+        traceRequest = 0;
+        write_trace(vm->trace);
+    }
+
+    // Schedule next poll at the nearest interval boundary
+    size_t nextPoll = instrCount + POLL_INTERVAL;
+    if (checkpoint && (instrCount / checkpoint + 1) * checkpoint < nextPoll) {
+        nextPoll = (instrCount / checkpoint + 1) * checkpoint;
+    }
+    if (syncInterval && (instrCount / syncInterval + 1) * syncInterval < nextPoll) {
+        nextPoll = (instrCount / syncInterval + 1) * syncInterval;
+    }
+    if (vm->instrLimit) {
+        if (instrCount >= vm->instrLimit) {
+            *status = INSTR_LIMIT;
+        }
+        if (vm->instrLimit < nextPoll) {
+            nextPoll = vm->instrLimit;
+        }
+    }
+
+    return nextPoll;
+}
+
+
+
+// Returns the working registers to a halted machine and writes out its output, trace and memory
+int stop_machine( Machine *vm, size_t ip, size_t instrCount, int status ) {
+    vm->instrPtr = ip;
+    vm->instrCount += instrCount;
+    if (ip < NUM_MEM_WORDS || NULL != vm->mem.pages) {
+        vm->instrReg = read_word(&vm->mem, ip);
+    }
+
+    if (INV_ADDR == status) {
+        format_channel(vm->output, "\nWord %zu - invalid memory address\n\n", vm->instrPtr);
+    }
+    if (flush_channel(vm->output) && !status) {     // Buffered output goes out at END
+        status = PROG_ACC_ERR;
+    }
+    if (NULL != vm->trace && write_trace(vm->trace) && !status) {   // As does the trace, on END or error
+        status = PROG_ACC_ERR;
+    }
+    if (NULL != vm->live) {
+        publish_live(vm->live, vm, ip, 0);
+    }
+
+    if (vm->persist) {
+        if (write_mem(&vm->mem)) { return MEM_ACC_ERR; }    // Write back memory
+        sync_memf(&vm->mem);
+    }
+
+    return status;
+}
+
+
+
+// Pre-decodes the instruction word at a memory address
+// Prefixed instructions and operands beyond base memory are left to the extended path
+// Debugged words under breakpoints decode to a trap, and stores to the extended path while any words are watched
+void decode_instr( Memory *mem, size_t address, Decoded *instr, Debugger *debugger ) {
+    size_t next = decode_word(mem, address, instr);
+
+    if (next > address + 1 || (H_END != instr->handler && H_NOP != instr->handler && instr->target >= NUM_MEM_WORDS)) {
+        instr->handler = H_EXTENDED;
+    }
+    if (NULL != debugger && address < NUM_MEM_WORDS) {
+        if (DEBUG_BIT(debugger->breakpoints, address)) {
+            instr->handler = H_BREAK;
+        } else if (debugger->numWatchpoints && STORES_MEMORY(instr->handler)) {
+            instr->handler = H_EXTENDED;
+        }
+    }
+}
+
+
+
+// Decodes the instruction at a memory address, along with any address prefixes
+// Each prefix shifts its operand into the address bits above the instruction's operand
+// Returns the address of the following instruction
+size_t decode_word( Memory *mem, size_t address, Decoded *instr ) {
+    size_t limit = NULL == mem->pages ? NUM_MEM_WORDS : EXT_NUM_WORDS;
+    size_t extension = 0;   // Address bits from prefixes
+    WORD_TYPE word = read_word(mem, address);
+
+    for (size_t prefix = 0; NULL != mem->pages && EXT == word / 0x100 && prefix < EXT_MAX_PREFIXES; prefix++) {
+        extension = extension << 8 | (size_t) (word % 0x100);
+        word = read_word(mem, ++address);
+    }
+    decode_fields(word, extension, limit, instr);
+
+    return address + 1;
+}
+
+
+
+// Decodes the opcode and operand of an instruction word, given the address bits of its prefixes
+// Operands at or past the limit decode as bad addresses
+void decode_fields( WORD_TYPE word, size_t extension, size_t limit, Decoded *instr ) {
+    WORD_TYPE opcode = word / 0x100;    // Decode
+    WORD_TYPE operand = word % 0x100;
+
+    instr->operand = operand;
+    instr->target = (extension << 8) + operand;     // Operand address and branch destination
+
+    switch (opcode) {
+        case RDI:   instr->handler = H_RDI;     break;
+        case RDS:   instr->handler = H_RDS;     break;
+        case PRTI:  instr->handler = H_PRTI;    break;
+        case PRTS:  instr->handler = H_PRTS;    break;
+        case B:     instr->handler = H_B;       break;
+        case BN:    instr->handler = H_BN;      break;
+        case BZ:    instr->handler = H_BZ;      break;
+        case LOAD:  instr->handler = H_LOAD;    break;
+        case STORE: instr->handler = H_STORE;   break;
+        case ADD:   instr->handler = H_ADD;     break;
+        case SUB:   instr->handler = H_SUB;     break;
+        case BCPY:  instr->handler = H_BCPY;    break;
+        case BFIL:  instr->handler = H_BFIL;    break;
+        case BCMP:  instr->handler = H_BCMP;    break;
+        case BSCH:  instr->handler = H_BSCH;    break;
+        case BADD:  instr->handler = H_BADD;    break;
+        case CAS:   instr->handler = H_CAS;     break;
+        case FADD:  instr->handler = H_FADD;    break;
+        case WAIT:  instr->handler = H_WAIT;    break;
+        case END:   instr->handler = H_END;     return;
+        default:    instr->handler = H_NOP;     return;
+    }
+
+    // Trap operands outside of TIMS memory, CAS also reading the word after its operand
+    if (operand < 0 || instr->target >= limit || (H_CAS == instr->handler && instr->target + 1 >= limit)) {
+        instr->handler = H_BAD_ADDR;
+    }
+}
+
+
+
+// Executes the instruction at the instruction pointer straight from memory,
+// for instructions the pre-decoded cache can't hold when extended memory is in use
+// Sets the range of base memory words stored to, whose cached decodes are stale
+// Returns the handler run, leaving the instruction pointer on END and bad addresses,
+// or WATCHPOINT past a debugged store to a watched word
+int step_extended( Machine *vm, size_t *ip, size_t stored[2] ) {
+    Memory *mem = &vm->mem;
+    Decoded instr;
+    size_t next = decode_word(mem, *ip, &instr);
+    if (*ip >= EXT_NUM_WORDS) {     // Ran off the end of extended memory
+        instr.handler = H_BAD_ADDR;
+    }
+
+    // Strings stay within base memory or their page
+    size_t span = instr.target < NUM_MEM_WORDS ? NUM_MEM_WORDS - instr.target : EXT_PAGE_WORDS - instr.target % EXT_PAGE_WORDS;
+    size_t numStored = 0;
+    WORD_TYPE *word = NULL;
+    char *string = NULL;
+    size_t length = 0;
+    int status = 0;
+
+    stored[0] = stored[1] = 0;
+    switch (instr.handler) {
+        case H_RDI:
+            word = page_word(mem, instr.target, 1);
+            if (NULL == word) { return MEM_ACC_ERR; }
+            read_int(vm->input, &vm->ioIntBuff);    // Keeps last value if none read
+            *word = (WORD_TYPE) vm->ioIntBuff;
+            numStored = 1;
+            break;
+        case H_RDS:
+            word = page_word(mem, instr.target, 1);
+            if (NULL == word) { return MEM_ACC_ERR; }
+            length = read_line(vm->input, (char *) word, span * sizeof(WORD_TYPE));
+            numStored = (length + sizeof(WORD_TYPE) - 1) / sizeof(WORD_TYPE);
+            break;
+        case H_PRTI:
+            write_int(vm->output, read_word(mem, instr.target));
+            break;
+        case H_PRTS:
+            word = page_word(mem, instr.target, 0);
+            if (NULL != word) {     // Untouched pages hold empty strings
+                string = (char *) word;
+                length = span * sizeof(WORD_TYPE);
+                char *end = memchr(string, '\0', length);
+                if (NULL != end) {
+                    length = end - string;
+                }
+                write_bytes(vm->output, string, length);
+            }
+            write_bytes(vm->output, "\n", 1);
+            break;
+        case H_LOAD:
+            vm->accumulator = read_word(mem, instr.target);
+            break;
+        case H_STORE:
+            word = page_word(mem, instr.target, 1);
+            if (NULL == word) { return MEM_ACC_ERR; }
+            *word = vm->accumulator;
+            numStored = 1;
+            break;
+        case H_ADD:
+            vm->accumulator = (WORD_TYPE) (vm->accumulator + read_word(mem, instr.target));
+            break;
+        case H_SUB:
+            vm->accumulator = (WORD_TYPE) (vm->accumulator - read_word(mem, instr.target));
+            break;
+        case H_BCPY:
+        case H_BFIL:
+        case H_BCMP:
+        case H_BSCH:
+        case H_BADD:
+            status = execute_bulk(mem, instr.handler, instr.target, &vm->accumulator, stored);
+            if (status) { return status; }
+            break;
+        case H_CAS:
+        case H_FADD:
+            if (NULL == page_word(mem, instr.target, 1)) { return MEM_ACC_ERR; }
+            numStored = execute_atomic(mem, instr.handler, instr.target, &vm->accumulator);
+            break;
+        case H_B:
+            next = instr.target;
+            break;
+        case H_BN:
+            next = vm->accumulator < 0 ? instr.target : next;
+            break;
+        case H_BZ:
+            next = !vm->accumulator ? instr.target : next;
+            break;
+        case H_END:
+        case H_BAD_ADDR:
+            return instr.handler;
+    }
+
+    // Stores to base memory show in the formatted memory file and the decode cache
+    if (numStored && instr.target < NUM_MEM_WORDS) {
+        stored[0] = instr.target;
+        stored[1] = instr.target + numStored;
+        for (size_t address = stored[0]; address < stored[1]; address++) {
+            mark_dirty(mem, address);
+        }
+    }
+
+    *ip = next;
+    return NULL != vm->debugger && watch_hit(vm->debugger, stored[0], stored[1]) ? WATCHPOINT : instr.handler;
+}
+
+
+
+// Dump the register contents, leaving the machine as it was
+void dump( Machine *vm ) {
+    write_bytes(vm->output, "\nREGISTERS:\n", 12);
+    format_channel(vm->output, "%-24s0x%02zx\n", "Instruction Pointer", vm->instrPtr);
+    format_channel(vm->output, "%-22s0x%04x\n", "Instruction Register", vm->instrReg);
+    format_channel(vm->output, "%-22s0x%04x\n\n", "Accumulator", vm->accumulator);
+    flush_channel(vm->output);
+}
+
+
+
+// ______________________________
+//          BULK MEMORY
+// ______________________________
+
+
+
+// Runs CAS or FADD on a single core, where nothing can interleave, leaving the word's old value in the accumulator
+// CAS replaces a word holding the accumulator with the word after it and FADD adds the accumulator to a word
+// Returns true if the word was stored to
+int execute_atomic( Memory *mem, int handler, size_t address, WORD_TYPE *accumulator ) {
+    WORD_TYPE *word = page_word(mem, address, 1);
+    WORD_TYPE old = *word;
+    int store = H_FADD == handler || old == *accumulator;
+
+    if (store) {
+        *word = H_FADD == handler ? (WORD_TYPE) (old + *accumulator) : read_word(mem, address + 1);
+        if (address < NUM_MEM_WORDS) {
+            mark_dirty(mem, address);
+        }
+    }
+    *accumulator = old;
+
+    return store;
+}
+
+
+
+// Runs a bulk instruction over the parameter block at an address: destination, source or value, and count
+// BCMP sets the accumulator to the sign of the first difference and BSCH to the offset of the first match or -1
+// Ranges lie within base memory or one page of extended memory, and BADD reads a source overlapping its
+// destination in full first, as BCPY does
+// Sets the range of base memory words stored to
+// Returns INV_ADDR, with memory unchanged, if the parameter block or a range is outside of memory
+int execute_bulk( Memory *mem, int handler, size_t params, WORD_TYPE *accumulator, size_t stored[2] ) {
+    stored[0] = stored[1] = 0;
+    if (!bulk_range(mem, params, 3)) { return INV_ADDR; }
+
+    size_t dstAddress = (unsigned short) read_word(mem, params);
+    WORD_TYPE value = read_word(mem, params + 1);
+    size_t srcAddress = (unsigned short) value;
+    size_t count = (unsigned short) read_word(mem, params + 2);
+    int hasSource = H_BCPY == handler || H_BCMP == handler || H_BADD == handler;
+    if (!bulk_range(mem, dstAddress, count) || (hasSource && !bulk_range(mem, srcAddress, count))) { return INV_ADDR; }
+    if (!count) {
+        *accumulator = H_BSCH == handler ? -1 : H_BCMP == handler ? 0 : *accumulator;
+        return 0;
+    }
+
+    // Pages are allocated for reads too, as whole ranges are worked on in place
+    WORD_TYPE *dst = page_word(mem, dstAddress, 1);
+    WORD_TYPE *src = hasSource ? page_word(mem, srcAddress, 1) : dst;
+    if (NULL == dst || NULL == src) { return MEM_ACC_ERR; }
+
+    WORD_TYPE copy[EXT_PAGE_WORDS];     // Source of an overlapping BADD
+    size_t index = 0;
+    switch (handler) {
+        case H_BCPY:
+            memmove(dst, src, count * sizeof(WORD_TYPE));
+            break;
+        case H_BFIL:
+            bulk_fill(dst, value, count);
+            break;
+        case H_BCMP:
+            index = bulk_compare(dst, src, count);
+            *accumulator = index == count ? 0 : dst[index] < src[index] ? -1 : 1;
+            return 0;
+        case H_BSCH:
+            index = bulk_search(dst, value, count);
+            *accumulator = index == count ? -1 : (WORD_TYPE) index;
+            return 0;
+        case H_BADD:
+            if (dst > src && dst < src + count) {   // Would read words already added to
+                memcpy(copy, src, count * sizeof(WORD_TYPE));
+                src = copy;
+            }
+            bulk_add(dst, src, count);
+            break;
+    }
+
+    // Stores to base memory show in the formatted memory file and the decode cache
+    if (dstAddress < NUM_MEM_WORDS) {
+        stored[0] = dstAddress;
+        stored[1] = dstAddress + count;
+        for (size_t address = stored[0]; address < stored[1]; address++) {
+            mark_dirty(mem, address);
+        }
+    }
+
+    return 0;
+}
+
+
+
+// Returns true if a range of words lies within base memory or one page of extended memory
+int bulk_range( Memory *mem, size_t address, size_t count ) {
+    if (address < NUM_MEM_WORDS) {
+        return address + count <= NUM_MEM_WORDS;
+    }
+
+    return NULL != mem->pages && address < EXT_NUM_WORDS && address % EXT_PAGE_WORDS + count <= EXT_PAGE_WORDS;
+}
+
+
+
+// Fills words with a value, through memset where its bytes match
+void bulk_fill( WORD_TYPE dst[], WORD_TYPE value, size_t count ) {
+    if ((unsigned char) value == (unsigned char) ((unsigned short) value >> 8)) {
+        memset(dst, (unsigned char) value, count * sizeof(WORD_TYPE));
+        return;
+    }
+
+    size_t done = 0;
+#ifdef VECTOR_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        done = fill_avx2(dst, value, count);
+    }
+    __m128i fill = _mm_set1_epi16(value);
+    for (; done + 8 <= count; done += 8) {
+        _mm_storeu_si128((__m128i *) &dst[done], fill);
+    }
+#endif
+    for (; done < count; done++) {
+        dst[done] = value;
+    }
+}
+
+
+
+// Returns the index of the first word differing between two ranges, or count if none do
+size_t bulk_compare( const WORD_TYPE a[], const WORD_TYPE b[], size_t count ) {
+    size_t done = 0;
+#ifdef VECTOR_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        done = compare_avx2(a, b, count);
+    }
+    for (; done + 8 <= count; done += 8) {
+        __m128i equal = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) &a[done]), _mm_loadu_si128((const __m128i *) &b[done]));
+        unsigned int differ = ~(unsigned int) _mm_movemask_epi8(equal) & 0xffff;
+        if (differ) { return done + __builtin_ctz(differ) / 2; }
+    }
+#endif
+    while (done < count && a[done] == b[done]) {
+        done++;
+    }
+
+    return done;
+}
+
+
+
+// Returns the index of the first word equal to a value, or count if none is
+size_t bulk_search( const WORD_TYPE words[], WORD_TYPE value, size_t count ) {
+    size_t done = 0;
+#ifdef VECTOR_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        done = search_avx2(words, value, count);
+    }
+    __m128i match = _mm_set1_epi16(value);
+    for (; done + 8 <= count; done += 8) {
+        unsigned int found = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) &words[done]), match));
+        if (found) { return done + __builtin_ctz(found) / 2; }
+    }
+#endif
+    while (done < count && words[done] != value) {
+        done++;
+    }
+
+    return done;
+}
+
+
+
+// Adds each source word to its destination word, wrapping on overflow
+// A source overlapping the destination must not lie below it
+void bulk_add( WORD_TYPE dst[], const WORD_TYPE src[], size_t count ) {
+    size_t done = 0;
+#ifdef VECTOR_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        done = add_avx2(dst, src, count);
+    }
+    for (; done + 8 <= count; done += 8) {
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128((const __m128i *) &dst[done]), _mm_loadu_si128((const __m128i *) &src[done]));
+        _mm_storeu_si128((__m128i *) &dst[done], sum);
+    }
+#endif
+    for (; done < count; done++) {
+        dst[done] = (WORD_TYPE) (dst[done] + src[done]);
+    }
+}
+
+
+
+#ifdef VECTOR_KERNELS
+
+// The AVX2 kernels work over whole vectors from the start of a range and return the words done,
+// leaving the rest to the SSE2 and scalar loops of their callers
+// Compare and search stop at the vector holding the first difference or match
+
+__attribute__((target("avx2"))) size_t fill_avx2( WORD_TYPE dst[], WORD_TYPE value, size_t count ) {
+    __m256i fill = _mm256_set1_epi16(value);
+    size_t done = 0;
+    for (; done + 16 <= count; done += 16) {
+        _mm256_storeu_si256((__m256i *) &dst[done], fill);
+    }
+
+    return done;
+}
+
+
+
+__attribute__((target("avx2"))) size_t compare_avx2( const WORD_TYPE a[], const WORD_TYPE b[], size_t count ) {
+    size_t done = 0;
+    for (; done + 16 <= count; done += 16) {
+        __m256i equal = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) &a[done]), _mm256_loadu_si256((const __m256i *) &b[done]));
+        if (~(unsigned int) _mm256_movemask_epi8(equal)) { break; }
+    }
+
+    return done;
+}
+
+
+
+__attribute__((target("avx2"))) size_t search_avx2( const WORD_TYPE words[], WORD_TYPE value, size_t count ) {
+    __m256i match = _mm256_set1_epi16(value);
+    size_t done = 0;
+    for (; done + 16 <= count; done += 16) {
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) &words[done]), match))) { break; }
+    }
+
+    return done;
+}
+
+
+
+__attribute__((target("avx2"))) size_t add_avx2( WORD_TYPE dst[], const WORD_TYPE src[], size_t count ) {
+    size_t done = 0;
+    for (; done + 16 <= count; done += 16) {
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *) &dst[done]), _mm256_loadu_si256((const __m256i *) &src[done]));
+        _mm256_storeu_si256((__m256i *) &dst[done], sum);
+    }
+
+    return done;
+}
+
+#endif
+
+
+
+// ______________________________
+//              JIT
+// ______________________________
+
+
+
+#ifdef JIT_SUPPORTED
+
+// Executes TIMS program as native x86-64 code, compiling each basic block when first reached
+// Blocks chain to compiled branch targets directly and to the rest through the entry table,
+// returning here only to poll, compile or stop
+// A store to compiled code drops the code and hands the rest of the run to the interpreter,
+// as do profiling, tracing, debugging, extended memory and starting outside of memory
+int execute_jit( Machine *vm ) {
+    if (NULL != vm->profile || NULL != vm->trace || NULL != vm->debugger || NULL != vm->mem.pages || vm->instrPtr >= NUM_MEM_WORDS) {
+        return execute(vm);
+    }
+
+    Jit *jit = open_jit(vm);
+    if (NULL == jit) { return execute(vm); }    // No executable memory
+
+    size_t ip = vm->instrPtr;
+    size_t instrCount = 0;
+    unsigned int exit = 0;
+    int status = 0;
+
+    for (;;) {
+        size_t nextPoll = poll_machine(vm, ip, instrCount, &status);
+        if (status) { break; }
+
+        // Run up to the next poll, compiling blocks as execution reaches them
+        size_t budget = jit->remaining = nextPoll - instrCount;
+        do {
+            if (!jit->compiled[ip] && compile_block(jit, ip)) {
+                exit = JIT_EXIT(JIT_FALLBACK, ip);
+                break;
+            }
+            exit = jit->enter(jit, jit->entries[ip]);
+            ip = exit & 0xffff;
+        } while (JIT_MISS == exit >> 16);
+        instrCount += budget - jit->remaining;
+
+        if (JIT_POLL != exit >> 16) { break; }
+    }
+    close_jit(jit);
+
+    if (JIT_FALLBACK == exit >> 16) {
+        vm->instrPtr = ip;
+        return interpret(vm, instrCount);
+    }
+    if (JIT_BAD_ADDR == exit >> 16) {
+        status = INV_ADDR;
+    }
+
+    return stop_machine(vm, ip, instrCount, status);
+}
+
+
+
+// Allocates a JIT for a machine, with the trampoline, epilogue and exit stubs in a new code buffer
+// The code buffer is left executable
+Jit *open_jit( Machine *vm ) {
+    Jit *jit = calloc(1, sizeof(Jit));
+    if (NULL == jit) { return NULL; }
+    jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == jit->code) {
+        free(jit);
+        return NULL;
+    }
+    jit->vm = vm;
+    jit->accumulator = &vm->accumulator;
+
+    // Trampoline saves the registers compiled code runs in, loads them and jumps to the code
+    jit->enter = (unsigned int (*)( Jit *, void * )) (void *) jit->code;
+    emit(jit, 8, 0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xfb);  // push rbx, r12, r13; mov rbx, rdi
+    emit(jit, 3, 0x4c, 0x8b, 0xa3);     // mov r12, [rbx + accumulator]
+    emit32(jit, offsetof(Jit, accumulator));
+    emit(jit, 3, 0x4c, 0x8b, 0xab);     // mov r13, [rbx + remaining]
+    emit32(jit, offsetof(Jit, remaining));
+    emit(jit, 2, 0xff, 0xe6);           // jmp rsi
+
+    // Epilogue stores the remaining instructions and returns the exit reason in eax
+    jit->epilogue = &jit->code[jit->used];
+    emit(jit, 3, 0x4c, 0x89, 0xab);     // mov [rbx + remaining], r13
+    emit32(jit, offsetof(Jit, remaining));
+    emit(jit, 6, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3);   // pop r13, r12, rbx; ret
+
+    // Exit to poll before a word once no instructions remain, or to compile a word
+    for (size_t word = 0; word <= NUM_MEM_WORDS; word++) {
+        jit->pollStubs[word] = &jit->code[jit->used];
+        emit(jit, 3, 0x45, 0x31, 0xed);     // xor r13d, r13d
+        emit_exit(jit, JIT_EXIT(JIT_POLL, word));
+    }
+    for (size_t word = 0; word < NUM_MEM_WORDS; word++) {
+        jit->entries[word] = &jit->code[jit->used];
+        emit_exit(jit, JIT_EXIT(JIT_MISS, word));
+    }
+
+    // Running off the end of memory
+    jit->entries[NUM_MEM_WORDS] = &jit->code[jit->used];
+    jit->compiled[NUM_MEM_WORDS] = 1;
+    emit(jit, 5, 0x4d, 0x85, 0xed, 0x0f, 0x84);     // test r13, r13; jz poll stub
+    emit_rel32(jit, jit->pollStubs[NUM_MEM_WORDS]);
+    emit_exit(jit, JIT_EXIT(JIT_BAD_ADDR, NUM_MEM_WORDS));
+
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC)) {
+        close_jit(jit);
+        return NULL;
+    }
+
+    return jit;
+}
+
+
+
+// Frees a JIT and its code buffer
+void close_jit( Jit *jit ) {
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+}
+
+
+
+// Compiles the basic block starting at a word, up to a branch, END or a word compiled already
+// Every instruction polls first if none remain, so instruction counts match the interpreter
+// Returns nonzero if the code buffer can't take the block
+int compile_block( Jit *jit, size_t start ) {
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_WRITE)) { return PROG_ACC_ERR; }
+
+    int status = 0;
+    Decoded instr;
+    for (size_t word = start; !status; word++) {
+        if (jit->compiled[word]) {  // Fall through to compiled code
+            emit(jit, 1, 0xe9);
+            emit_rel32(jit, jit->entries[word]);
+            break;
+        }
+        if (jit->used + JIT_INSTR_SIZE > JIT_CODE_SIZE) {
+            status = PROG_ACC_ERR;
+            break;
+        }
+
+        decode_instr(&jit->vm->mem, word, &instr, NULL);
+        jit->entries[word] = &jit->code[jit->used];
+        jit->compiled[word] = 1;
+
+        // END and bad addresses stop uncounted
+        if (H_END == instr.handler || H_BAD_ADDR == instr.handler) {
+            emit(jit, 5, 0x4d, 0x85, 0xed, 0x0f, 0x84);     // test r13, r13; jz poll stub
+            emit_rel32(jit, jit->pollStubs[word]);
+            emit_exit(jit, JIT_EXIT(H_END == instr.handler ? JIT_END : JIT_BAD_ADDR, word));
+            break;
+        }
+
+        emit(jit, 6, 0x49, 0x83, 0xed, 0x01, 0x0f, 0x82);   // sub r13, 1; jc poll stub
+        emit_rel32(jit, jit->pollStubs[word]);
+
+        switch (instr.handler) {
+            case H_RDI:     // Reads exit to the interpreter after storing to compiled code
+            case H_RDS:
+                emit_call(jit, H_RDI == instr.handler ? (void *) jit_rdi : (void *) jit_rds, instr.operand);
+                emit(jit, 4, 0x85, 0xc0, 0x74, 0x0a);   // test eax, eax; jz over exit
+                emit_exit(jit, JIT_EXIT(JIT_FALLBACK, word + 1));
+                break;
+            case H_PRTI:
+                emit_call(jit, (void *) jit_prti, instr.operand);
+                break;
+            case H_PRTS:
+                emit_call(jit, (void *) jit_prts, instr.operand);
+                break;
+            case H_LOAD:
+                emit_load(jit, instr.operand);
+                emit(jit, 5, 0x66, 0x41, 0x89, 0x04, 0x24);     // mov [r12], ax
+                break;
+            case H_ADD:
+                emit_load(jit, instr.operand);
+                emit(jit, 5, 0x66, 0x41, 0x01, 0x04, 0x24);     // add [r12], ax
+                break;
+            case H_SUB:
+                emit_load(jit, instr.operand);
+                emit(jit, 5, 0x66, 0x41, 0x29, 0x04, 0x24);     // sub [r12], ax
+                break;
+            case H_STORE:   // Exits to the interpreter after storing to compiled code
+                emit_call(jit, (void *) jit_store, instr.operand);
+                emit(jit, 4, 0x85, 0xc0, 0x74, 0x0a);   // test eax, eax; jz over exit
+                emit_exit(jit, JIT_EXIT(JIT_FALLBACK, word + 1));
+                break;
+            case H_CAS:     // Exits to the interpreter after storing to compiled code
+            case H_FADD:
+                emit_call(jit, (void *) jit_atomic, (WORD_TYPE) word);
+                emit(jit, 4, 0x85, 0xc0, 0x74, 0x0a);   // test eax, eax; jz over exit
+                emit_exit(jit, JIT_EXIT(JIT_FALLBACK, word + 1));
+                break;
+            case H_BCPY:    // Exits to the interpreter after storing to compiled code, or stops uncounted on bad ranges
+            case H_BFIL:
+            case H_BCMP:
+            case H_BSCH:
+            case H_BADD:
+                emit_call(jit, (void *) jit_bulk, (WORD_TYPE) word);
+                emit(jit, 4, 0x85, 0xc0, 0x74, 0x1d);   // test eax, eax; jz over exits
+                emit(jit, 5, 0x83, 0xf8, 0x01, 0x75, 0x0a);     // cmp eax, 1; jne over exit
+                emit_exit(jit, JIT_EXIT(JIT_FALLBACK, word + 1));
+                emit(jit, 4, 0x49, 0x83, 0xc5, 0x01);   // add r13, 1
+                emit_exit(jit, JIT_EXIT(JIT_BAD_ADDR, word));
+                break;
+            case H_B:
+                emit_branch(jit, 0, instr.target);
+                break;
+            case H_BN:
+                emit_branch(jit, 0x8c, instr.target);   // jl
+                break;
+            case H_BZ:
+                emit_branch(jit, 0x84, instr.target);   // je
+                break;
+        }
+        if (H_B == instr.handler) { break; }
+    }
+
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC)) { return PROG_ACC_ERR; }
+
+    return status;
+}
+
+
+
+// Emits code bytes, given as ints
+void emit( Jit *jit, size_t length, ... ) {
+    va_list bytes;
+    va_start(bytes, length);
+    for (size_t i = 0; i < length; i++) {
+        jit->code[jit->used++] = (unsigned char) va_arg(bytes, int);
+    }
+    va_end(bytes);
+}
+
+
+
+// Emits a little endian 32 bit immediate or displacement
+void emit32( Jit *jit, unsigned int value ) {
+    for (size_t i = 0; i < 4; i++) {
+        jit->code[jit->used++] = (unsigned char) (value >> 8*i);
+    }
+}
+
+
+
+// Emits the offset of a jump target from the end of the offset
+void emit_rel32( Jit *jit, void *target ) {
+    emit32(jit, (unsigned int) ((unsigned char *) target - &jit->code[jit->used + 4]));
+}
+
+
+
+// Emits a jump to the epilogue with an exit reason and instruction address
+void emit_exit( Jit *jit, unsigned int exit ) {
+    emit(jit, 1, 0xb8);     // mov eax, exit
+    emit32(jit, exit);
+    emit(jit, 1, 0xe9);     // jmp epilogue
+    emit_rel32(jit, jit->epilogue);
+}
+
+
+
+// Emits a call of an I/O helper with the JIT and an operand
+void emit_call( Jit *jit, void *helper, WORD_TYPE operand ) {
+    emit(jit, 4, 0x48, 0x89, 0xdf, 0xbe);   // mov rdi, rbx; mov esi, operand
+    emit32(jit, operand);
+    emit(jit, 2, 0x48, 0xb8);               // mov rax, helper
+    emit32(jit, (unsigned int) (unsigned long) helper);
+    emit32(jit, (unsigned int) ((unsigned long) helper >> 32));
+    emit(jit, 2, 0xff, 0xd0);               // call rax
+}
+
+
+
+// Emits a load of a memory word to eax
+void emit_load( Jit *jit, WORD_TYPE address ) {
+    unsigned long word = (unsigned long) &jit->vm->mem.words[address];
+    emit(jit, 2, 0x48, 0xb8);       // mov rax, word
+    emit32(jit, (unsigned int) word);
+    emit32(jit, (unsigned int) (word >> 32));
+    emit(jit, 3, 0x0f, 0xb7, 0x00); // movzx eax, word [rax]
+}
+
+
+
+// Emits a branch taken if the accumulator meets a condition, given as the second byte of a near jcc,
+// or always taken if the condition is 0
+// Compiled targets are jumped to directly, others through their entry
+void emit_branch( Jit *jit, unsigned char condition, size_t target ) {
+    if (condition) {
+        emit(jit, 6, 0x66, 0x41, 0x83, 0x3c, 0x24, 0x00);   // cmp word [r12], 0
+    }
+
+    if (jit->compiled[target]) {
+        if (condition) {
+            emit(jit, 2, 0x0f, condition);  // jcc target
+        } else {
+            emit(jit, 1, 0xe9);             // jmp target
+        }
+        emit_rel32(jit, jit->entries[target]);
+    } else {
+        if (condition) {
+            emit(jit, 2, (condition ^ 1) - 0x10, 0x06);     // Short jcc on the opposite condition, over the jump
+        }
+        emit(jit, 2, 0xff, 0xa3);   // jmp [rbx + entries + target]
+        emit32(jit, offsetof(Jit, entries) + target * sizeof(void *));
+    }
+}
+
+
+
+// Reads an integer from input to memory for compiled code
+// Returns nonzero if the word is compiled
+int jit_rdi( Jit *jit, int address ) {
+    Memory *mem = &jit->vm->mem;
+    read_int(jit->vm->input, &jit->vm->ioIntBuff);  // Keeps last value if none read
+    mem->words[address] = (WORD_TYPE) jit->vm->ioIntBuff;
+    mark_dirty(mem, address);
+    return jit->compiled[address];
+}
+
+
+
+// Reads a string line from input to memory for compiled code
+// Returns nonzero if any word stored to is compiled
+int jit_rds( Jit *jit, int address ) {
+    Memory *mem = &jit->vm->mem;
+    char *memBytes = (char *) mem->words;
+    size_t length = read_line(jit->vm->input, &memBytes[address * sizeof(WORD_TYPE)], sizeof(mem->words) - address * sizeof(WORD_TYPE));
+
+    int compiled = 0;
+    for (size_t word = address; (word - address) * sizeof(WORD_TYPE) < length; word++) {
+        mark_dirty(mem, word);
+        compiled |= jit->compiled[word];
+    }
+
+    return compiled;
+}
+
+
+
+// Prints an integer from memory for compiled code
+void jit_prti( Jit *jit, int address ) {
+    write_int(jit->vm->output, jit->vm->mem.words[address]);
+}
+
+
+
+// Prints a string from memory for compiled code
+void jit_prts( Jit *jit, int address ) {
+    write_string(jit->vm->output, &jit->vm->mem, address);
+}
+
+
+
+// Stores the accumulator to memory for compiled code
+// Returns nonzero if the word is compiled
+int jit_store( Jit *jit, int address ) {
+    Memory *mem = &jit->vm->mem;
+    mem->words[address] = jit->vm->accumulator;
+    mark_dirty(mem, address);
+    return jit->compiled[address];
+}
+
+
+
+// Runs the CAS or FADD instruction at a word for compiled code
+// Returns nonzero if it stored to a compiled word
+int jit_atomic( Jit *jit, int address ) {
+    Decoded instr;
+    decode_instr(&jit->vm->mem, address, &instr, NULL);
+    return execute_atomic(&jit->vm->mem, instr.handler, instr.operand, &jit->vm->accumulator) && jit->compiled[instr.operand];
+}
+
+
+
+// Runs the bulk instruction at a word for compiled code
+// Returns 1 if any word stored to is compiled, 2 if the instruction faulted without effect, else 0
+int jit_bulk( Jit *jit, int address ) {
+    Decoded instr;
+    size_t stored[2];
+    decode_instr(&jit->vm->mem, address, &instr, NULL);
+    if (execute_bulk(&jit->vm->mem, instr.handler, instr.operand, &jit->vm->accumulator, stored)) { return 2; }
+
+    int compiled = 0;
+    for (size_t word = stored[0]; word < stored[1]; word++) {
+        compiled |= jit->compiled[word];
+    }
+
+    return compiled;
+}
+
+#else
+
+// Native code needs x86-64, so run on the interpreter
+int execute_jit( Machine *vm ) {
+    return execute(vm);
+}
+
+#endif
+
+
+
+// ______________________________
+//           TRANSLATOR
+// ______________________________
+
+
+
+// Runtime of translated programs, following the I/O channel semantics of RDI/RDS/PRTI/PRTS
+static const char translatedRuntime[] =
+    "static short accumulator = 0;\n"
+    "static int ioIntBuff = 0;\n"
+    "\n"
+    "// Reads a decimal integer to memory, keeping the last value if none is read\n"
+    "// Returns nonzero if the word holds translated code\n"
+    "static int rdi( int address ) {\n"
+    "    int c = getchar();\n"
+    "    while (EOF != c && isspace(c)) {\n"
+    "        c = getchar();\n"
+    "    }\n"
+    "    int negative = '-' == c;\n"
+    "    if (negative || '+' == c) {\n"
+    "        c = getchar();\n"
+    "    }\n"
+    "\n"
+    "    unsigned int number = 0;\n"
+    "    size_t numDigits = 0;\n"
+    "    for (; EOF != c && isdigit(c); c = getchar(), numDigits++) {\n"
+    "        number = 10*number + (c - '0');\n"
+    "    }\n"
+    "    if (EOF != c) {\n"
+    "        ungetc(c, stdin);\n"
+    "    }\n"
+    "    if (numDigits) {\n"
+    "        ioIntBuff = negative ? -(int) number : (int) number;\n"
+    "    }\n"
+    "\n"
+    "    words[address] = (short) ioIntBuff;\n"
+    "    return code[address];\n"
+    "}\n"
+    "\n"
+    "// Reads a string line to memory, truncated at the end of memory\n"
+    "// Returns nonzero if any word stored to holds translated code\n"
+    "static int rds( int address ) {\n"
+    "    char *line = (char *) &words[address];\n"
+    "    size_t size = (NUM_MEM_WORDS - address) * sizeof(short);\n"
+    "    size_t length = 0;\n"
+    "    for (int c = getchar(); EOF != c && '\\n' != c; c = getchar()) {\n"
+    "        if (length < size) {\n"
+    "            line[length++] = (char) c;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    int stored = 0;\n"
+    "    for (size_t word = address; (word - address) * sizeof(short) < length; word++) {\n"
+    "        stored |= code[word];\n"
+    "    }\n"
+    "    return stored;\n"
+    "}\n"
+    "\n"
+    "// Prints an integer from memory\n"
+    "static void prti( int address ) {\n"
+    "    printf(\"%d\\n\", words[address]);\n"
+    "}\n"
+    "\n"
+    "// Prints a string from memory, stopping at NUL or the end of memory\n"
+    "static void prts( int address ) {\n"
+    "    const char *string = (const char *) &words[address];\n"
+    "    size_t length = (NUM_MEM_WORDS - address) * sizeof(short);\n"
+    "    const char *end = memchr(string, '\\0', length);\n"
+    "    fwrite(string, 1, NULL == end ? length : (size_t) (end - string), stdout);\n"
+    "    putchar('\\n');\n"
+    "}\n"
+    "\n"
+    "// Reports an operand or fetch outside of TIMS memory\n"
+    "static int bad_address( int address ) {\n"
+    "    printf(\"\\nWord %d - invalid memory address\\n\\n\", address);\n"
+    "    return EXIT_FAILURE;\n"
+    "}\n"
+    "\n"
+    "// Stores the accumulator to memory\n"
+    "// Returns nonzero if the word holds translated code\n"
+    "static int store( int address ) {\n"
+    "    words[address] = accumulator;\n"
+    "    return code[address];\n"
+    "}\n"
+    "\n"
+    "// Runs CAS or FADD, leaving the word's old value in the accumulator\n"
+    "// Returns nonzero if the word stored to holds translated code\n"
+    "static int atomic( int opcode, int address ) {\n"
+    "    short old = words[address];\n"
+    "    int store = FADD == opcode || old == accumulator;\n"
+    "    if (store) {\n"
+    "        words[address] = FADD == opcode ? (short) (old + accumulator) : words[address + 1];\n"
+    "    }\n"
+    "    accumulator = old;\n"
+    "    return store && code[address];\n"
+    "}\n"
+    "\n"
+    "// Runs a bulk instruction over its parameter block of destination, source or value, and count,\n"
+    "// exiting as a bad address at the given word if a range is outside of memory\n"
+    "// Returns nonzero if any word stored to holds translated code\n"
+    "static int bulk( int opcode, int params, int address ) {\n"
+    "    if (params + 3 > NUM_MEM_WORDS) { exit(bad_address(address)); }\n"
+    "    size_t dst = (unsigned short) words[params];\n"
+    "    short value = words[params + 1];\n"
+    "    size_t src = (unsigned short) value;\n"
+    "    size_t count = (unsigned short) words[params + 2];\n"
+    "    int hasSource = BCPY == opcode || BCMP == opcode || BADD == opcode;\n"
+    "    if (dst + count > NUM_MEM_WORDS || (hasSource && src + count > NUM_MEM_WORDS)) { exit(bad_address(address)); }\n"
+    "\n"
+    "    short source[NUM_MEM_WORDS];\n"
+    "    size_t i = 0;\n"
+    "    switch (opcode) {\n"
+    "        case BCPY:\n"
+    "            memmove(&words[dst], &words[src], count * sizeof(short));\n"
+    "            break;\n"
+    "        case BFIL:\n"
+    "            for (i = 0; i < count; i++) { words[dst + i] = value; }\n"
+    "            break;\n"
+    "        case BCMP:\n"
+    "            for (i = 0; i < count && words[dst + i] == words[src + i]; i++) {}\n"
+    "            accumulator = i == count ? 0 : words[dst + i] < words[src + i] ? -1 : 1;\n"
+    "            return 0;\n"
+    "        case BSCH:\n"
+    "            for (i = 0; i < count && words[dst + i] != value; i++) {}\n"
+    "            accumulator = i == count ? -1 : (short) i;\n"
+    "            return 0;\n"
+    "        case BADD:\n"
+    "            memcpy(source, &words[src], count * sizeof(short));\n"
+    "            for (i = 0; i < count; i++) { words[dst + i] = (short) (words[dst + i] + source[i]); }\n"
+    "            break;\n"
+    "    }\n"
+    "\n"
+    "    int stored = 0;\n"
+    "    for (i = dst; i < dst + count; i++) {\n"
+    "        stored |= code[i];\n"
+    "    }\n"
+    "    return stored;\n"
+    "}\n"
+    "\n"
+    "// Interprets the program from a word, once it has stored over its own code\n"
+    "static int interpret( int ip ) {\n"
+    "    for (;;) {\n"
+    "        if (ip >= NUM_MEM_WORDS) { return bad_address(ip); }\n"
+    "        int opcode = words[ip] / 0x100;\n"
+    "        int operand = words[ip] % 0x100;\n"
+    "        int addressed = (opcode >= RDI && opcode <= PRTS) || (opcode >= LOAD && opcode <= SUB)\n"
+    "                || (opcode >= B && opcode <= BZ) || (opcode >= BCPY && opcode <= BADD);\n"
+    "        addressed = addressed || FADD == opcode || WAIT == opcode;\n"
+    "        if ((addressed && (operand < 0 || operand >= NUM_MEM_WORDS)) || (CAS == opcode && (operand < 0 || operand + 1 >= NUM_MEM_WORDS))) {\n"
+    "            return bad_address(ip);\n"
+    "        }\n"
+    "\n"
+    "        switch (opcode) {\n"
+    "            case RDI:   rdi(operand);   ip++;   break;\n"
+    "            case RDS:   rds(operand);   ip++;   break;\n"
+    "            case PRTI:  prti(operand);  ip++;   break;\n"
+    "            case PRTS:  prts(operand);  ip++;   break;\n"
+    "            case LOAD:  accumulator = words[operand];   ip++;   break;\n"
+    "            case STORE: store(operand); ip++;   break;\n"
+    "            case ADD:   accumulator = (short) (accumulator + words[operand]);   ip++;   break;\n"
+    "            case SUB:   accumulator = (short) (accumulator - words[operand]);   ip++;   break;\n"
+    "            case BCPY:\n"
+    "            case BFIL:\n"
+    "            case BCMP:\n"
+    "            case BSCH:\n"
+    "            case BADD:  bulk(opcode, operand, ip);  ip++;   break;\n"
+    "            case CAS:\n"
+    "            case FADD:  atomic(opcode, operand);    ip++;   break;\n"
+    "            case B:     ip = operand;   break;\n"
+    "            case BN:    ip = accumulator < 0 ? operand : ip + 1;    break;\n"
+    "            case BZ:    ip = !accumulator ? operand : ip + 1;       break;\n"
+    "            case END:   return EXIT_SUCCESS;\n"
+    "            default:    ip++;   break;\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n";
+
+
+
+// Translates a loaded TIMS program to a standalone C program, with a statement per instruction word
+// reachable from the entry word and gotos to labelled words for branches
+// The memory image is embedded, and a store over translated code continues in an embedded interpreter
+int translate_program( char fileName[], Memory *mem, size_t entry ) {
+    if (entry >= NUM_MEM_WORDS) { return INV_ADDR; }
+
+    // Find the words execution can reach, including running off the end of memory, and branch targets
+    unsigned char code[NUM_MEM_WORDS + 1] = {0};
+    unsigned char labels[NUM_MEM_WORDS + 1] = {0};
+    size_t pending[NUM_MEM_WORDS + 1];
+    size_t numPending = 0;
+    Decoded instr;
+
+    pending[numPending++] = entry;
+    code[entry] = 1;
+    labels[entry] = 1;
+    while (numPending) {
+        size_t word = pending[--numPending];
+        if (NUM_MEM_WORDS == word) { continue; }
+
+        decode_instr(mem, word, &instr, NULL);
+        int next = H_B != instr.handler && H_END != instr.handler && H_BAD_ADDR != instr.handler;
+        int branch = H_B == instr.handler || H_BN == instr.handler || H_BZ == instr.handler;
+        if (next && !code[word + 1]) {
+            code[word + 1] = 1;
+            pending[numPending++] = word + 1;
+        }
+        if (branch && !code[instr.target]) {
+            code[instr.target] = 1;
+            pending[numPending++] = instr.target;
+        }
+        if (branch) {
+            labels[instr.target] = 1;
+        }
+    }
+
+    FILE *source = fopen(fileName, "w");
+    if (NULL == source) { return PROG_ACC_ERR; }
+
+    fprintf(source, "// Translated TIMS program\n\n");
+    fprintf(source, "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n#include <ctype.h>\n\n");
+    fprintf(source, "#define NUM_MEM_WORDS %u\n\n", NUM_MEM_WORDS);
+    fprintf(source, "#define RDI 0x%02x\n#define RDS 0x%02x\n#define PRTI 0x%02x\n#define PRTS 0x%02x\n", RDI, RDS, PRTI, PRTS);
+    fprintf(source, "#define B 0x%02x\n#define BN 0x%02x\n#define BZ 0x%02x\n#define END 0x%02x\n", B, BN, BZ, END);
+    fprintf(source, "#define LOAD 0x%02x\n#define STORE 0x%02x\n#define ADD 0x%02x\n#define SUB 0x%02x\n", LOAD, STORE, ADD, SUB);
+    fprintf(source, "#define BCPY 0x%02x\n#define BFIL 0x%02x\n#define BCMP 0x%02x\n#define BSCH 0x%02x\n#define BADD 0x%02x\n", BCPY, BFIL, BCMP, BSCH, BADD);
+    fprintf(source, "#define CAS 0x%02x\n#define FADD 0x%02x\n#define WAIT 0x%02x\n\n", CAS, FADD, WAIT);
+
+    // Memory image and translated words
+    fprintf(source, "static short words[NUM_MEM_WORDS] = {");
+    for (size_t word = 0; word < NUM_MEM_WORDS; word++) {
+        fprintf(source, "%s%6d,", word % MEMF_COLS ? "" : "\n   ", mem->words[word]);
+    }
+    fprintf(source, "\n};\n\nstatic const unsigned char code[NUM_MEM_WORDS] = {");
+    for (size_t word = 0; word < NUM_MEM_WORDS; word++) {
+        fprintf(source, "%s %u,", word % MEMF_COLS ? "" : "\n   ", code[word]);
+    }
+    fprintf(source, "\n};\n\n%s", translatedRuntime);
+
+    // Program
+    fprintf(source, "int main( void ) {\n    goto w%zu;\n\n", entry);
+    for (size_t word = 0; word < NUM_MEM_WORDS; word++) {
+        if (!code[word]) { continue; }
+
+        decode_instr(mem, word, &instr, NULL);
+        if (labels[word]) {
+            fprintf(source, "w%zu:\n", word);
+        }
+        fprintf(source, "    ");
+        switch (instr.handler) {
+            case H_RDI:     fprintf(source, "if (rdi(%d)) { return interpret(%zu); }\n", instr.operand, word + 1);    break;
+            case H_RDS:     fprintf(source, "if (rds(%d)) { return interpret(%zu); }\n", instr.operand, word + 1);    break;
+            case H_PRTI:    fprintf(source, "prti(%d);\n", instr.operand);  break;
+            case H_PRTS:    fprintf(source, "prts(%d);\n", instr.operand);  break;
+            case H_LOAD:    fprintf(source, "accumulator = words[%d];\n", instr.operand);  break;
+            case H_STORE:   fprintf(source, "if (store(%d)) { return interpret(%zu); }\n", instr.operand, word + 1);    break;
+            case H_ADD:     fprintf(source, "accumulator = (short) (accumulator + words[%d]);\n", instr.operand);  break;
+            case H_SUB:     fprintf(source, "accumulator = (short) (accumulator - words[%d]);\n", instr.operand);  break;
+            case H_BCPY:
+            case H_BFIL:
+            case H_BCMP:
+            case H_BSCH:
+            case H_BADD:    fprintf(source, "if (bulk(0x%02x, %d, %zu)) { return interpret(%zu); }\n", mem->words[word] / 0x100, instr.operand, word, word + 1);    break;
+            case H_CAS:
+            case H_FADD:    fprintf(source, "if (atomic(0x%02x, %d)) { return interpret(%zu); }\n", mem->words[word] / 0x100, instr.operand, word + 1);    break;
+            case H_B:       fprintf(source, "goto w%zu;\n", instr.target);   break;
+            case H_BN:      fprintf(source, "if (accumulator < 0) { goto w%zu; }\n", instr.target);  break;
+            case H_BZ:      fprintf(source, "if (!accumulator) { goto w%zu; }\n", instr.target);     break;
+            case H_END:     fprintf(source, "return EXIT_SUCCESS;\n");      break;
+            case H_BAD_ADDR:    fprintf(source, "return bad_address(%zu);\n", word); break;
+            default:        fprintf(source, ";\n");     break;  // No effect
+        }
+    }
+    if (code[NUM_MEM_WORDS]) {  // Fall through past the end of memory
+        fprintf(source, "    return bad_address(%u);\n", NUM_MEM_WORDS);
+    }
+    fprintf(source, "}\n");
+
+    if (fclose(source)) { return PROG_ACC_ERR; }
+    printf("\nTranslated program to \"%s\"\n\n", fileName);
+
+    return 0;
+}
+
+
+
+// ______________________________
+//            PROFILER
+// ______________________________
+
+
+
+// Counts an instruction about to execute and times I/O instructions
+// Kept out of execute() so profiling support costs unprofiled dispatch nothing
+void profile_instr( Profile *profile, size_t address, int handler, WORD_TYPE accumulator ) {
+    profile->counts[handler]++;
+    profile->hits[address]++;
+    profile->handlers[address] = handler;
+    if ((H_BN == handler && accumulator < 0) || (H_BZ == handler && !accumulator)) {
+        profile->taken[handler]++;
+    }
+
+    // Count pairs and triples run straight through, the sequences superinstructions replace
+    if (handler >= NUM_SEQ_HANDLERS) {
+        profile->runLength = 0;
+    } else if (profile->runLength && address == profile->lastAddress + 1) {
+        profile->pairs[profile->lastHandlers[0]][handler]++;
+        if (profile->runLength > 1) {
+            profile->triples[profile->lastHandlers[1]][profile->lastHandlers[0]][handler]++;
+        }
+        profile->runLength++;
+    } else {
+        profile->runLength = 1;
+    }
+    profile->lastAddress = address;
+    profile->lastHandlers[1] = profile->lastHandlers[0];
+    profile->lastHandlers[0] = handler;
+
+    // An instruction starts when the previous one ends, I/O handlers are numbered first
+    if (profile->ioStart || handler <= H_PRTS) {
+        double now = now_seconds();
+        if (profile->ioStart) {
+            profile->ioSeconds += now - profile->ioStart;
+        }
+        profile->ioStart = handler <= H_PRTS ? now : 0;
+    }
+}
+
+
+
+// Returns the name of a decoded instruction handler
+const char *handler_name( int handler ) {
+    static const char *const names[NUM_HANDLERS] = {
+        [H_RDI] = "RDI", [H_RDS] = "RDS", [H_PRTI] = "PRTI", [H_PRTS] = "PRTS",
+        [H_B] = "B", [H_BN] = "BN", [H_BZ] = "BZ", [H_END] = "END",
+        [H_NOP] = "NOP", [H_BAD_ADDR] = "BAD_ADDR", [H_DECODE] = "DECODE", [H_HOOK] = "HOOK",
+        [H_EXTENDED] = "EXTENDED", [H_LOAD] = "LOAD", [H_STORE] = "STORE", [H_ADD] = "ADD", [H_SUB] = "SUB",
+        [H_BCPY] = "BCPY", [H_BFIL] = "BFIL", [H_BCMP] = "BCMP", [H_BSCH] = "BSCH", [H_BADD] = "BADD",
+        [H_CAS] = "CAS", [H_FADD] = "FADD", [H_WAIT] = "WAIT", [H_BREAK] = "BREAK",
+        [H_LOAD_ADD_STORE] = "LOAD_ADD_STORE", [H_LOAD_SUB_STORE] = "LOAD_SUB_STORE", [H_LOAD_ADD] = "LOAD_ADD",
+        [H_LOAD_SUB] = "LOAD_SUB", [H_ADD_STORE] = "ADD_STORE", [H_SUB_STORE] = "SUB_STORE", [H_LOAD_BZ] = "LOAD_BZ",
+        [H_LOAD_BN] = "LOAD_BN", [H_BZ_BN] = "BZ_BN", [H_PRTI_B] = "PRTI_B", [H_PRTS_B] = "PRTS_B", [H_STORE_B] = "STORE_B"
+    };
+
+    return handler >= 0 && handler < NUM_HANDLERS ? names[handler] : "?";
+}
+
+
+
+// Orders profile counters by descending count, then ascending index
+int compare_entries( const void *a, const void *b ) {
+    const ProfileEntry *entryA = a;
+    const ProfileEntry *entryB = b;
+
+    if (entryA->count != entryB->count) {
+        return entryA->count < entryB->count ? 1 : -1;
+    }
+    return entryA->index < entryB->index ? -1 : entryA->index > entryB->index;
+}
+
+
+
+// Prints per-opcode and per-word counts, most executed first, and the I/O and dispatch times
+void print_profile( Profile *profile, FILE *report ) {
+    ProfileEntry entries[NUM_MEM_WORDS + 1];
+    size_t numEntries = 0;
+    size_t total = 0;
+
+    for (size_t h = 0; h < NUM_HANDLERS; h++) {
+        total += profile->counts[h];
+        if (profile->counts[h]) {
+            entries[numEntries++] = (ProfileEntry) {profile->counts[h], h};
+        }
+    }
+    double percent = total ? 100.0 / total : 0;
+
+    // Opcodes
+    qsort(entries, numEntries, sizeof(ProfileEntry), compare_entries);
+    fputs("\nPROFILE:\n", report);
+    fprintf(report, "%-10s%14s%9s%14s%14s\n", "Opcode", "Count", "%", "Taken", "Not taken");
+    for (size_t e = 0; e < numEntries; e++) {
+        size_t h = entries[e].index;
+        fprintf(report, "%-10s%14llu%8.2f%%", handler_name(h), (unsigned long long) profile->counts[h], profile->counts[h] * percent);
+        if (H_BN == h || H_BZ == h) {
+            fprintf(report, "%14llu%14llu", (unsigned long long) profile->taken[h], (unsigned long long) (profile->counts[h] - profile->taken[h]));
+        }
+        fputc('\n', report);
+    }
+
+    // Words
+    numEntries = 0;
+    for (size_t word = 0; word <= NUM_MEM_WORDS; word++) {
+        if (profile->hits[word]) {
+            entries[numEntries++] = (ProfileEntry) {profile->hits[word], word};
+        }
+    }
+    qsort(entries, numEntries, sizeof(ProfileEntry), compare_entries);
+    fprintf(report, "\n%-10s%-10s%14s%9s\n", "Word", "Opcode", "Hits", "%");
+    for (size_t e = 0; e < numEntries; e++) {
+        size_t word = entries[e].index;
+        fprintf(report, "0x%02zx      %-10s%14llu%8.2f%%\n", word, handler_name(profile->handlers[word]), (unsigned long long) profile->hits[word], profile->hits[word] * percent);
+    }
+
+    // Sequences
+    fprintf(report, "\n%-20s%14s%9s\n", "Sequence", "Count", "%");
+    print_sequences(profile, report, 3);
+    print_sequences(profile, report, 2);
+
+    fprintf(report, "\n%-22s%.6f s\n", "I/O time", profile->ioSeconds);
+    fprintf(report, "%-22s%.6f s\n\n", "Dispatch time", profile->totalSeconds - profile->ioSeconds);
+}
+
+
+
+// Prints the hottest pairs or triples run straight through, as shares of all instructions
+void print_sequences( Profile *profile, FILE *report, size_t length ) {
+    ProfileEntry entries[FUSE_REPORT + 1];
+    size_t numEntries = 0;
+    size_t total = 0;
+
+    for (size_t h = 0; h < NUM_HANDLERS; h++) {
+        total += profile->counts[h];
+    }
+
+    // Keep the hottest, sequences indexed by handler in base NUM_SEQ_HANDLERS
+    size_t numSequences = 2 == length ? NUM_SEQ_HANDLERS * NUM_SEQ_HANDLERS : NUM_SEQ_HANDLERS * NUM_SEQ_HANDLERS * NUM_SEQ_HANDLERS;
+    const size_t *counts = 2 == length ? &profile->pairs[0][0] : &profile->triples[0][0][0];
+    for (size_t sequence = 0; sequence < numSequences; sequence++) {
+        if (!counts[sequence]) { continue; }
+        size_t e = numEntries < FUSE_REPORT ? numEntries++ : FUSE_REPORT;
+        entries[e] = (ProfileEntry) {counts[sequence], sequence};
+        for (; e > 0 && compare_entries(&entries[e - 1], &entries[e]) > 0; e--) {
+            ProfileEntry swap = entries[e - 1];
+            entries[e - 1] = entries[e];
+            entries[e] = swap;
+        }
+    }
+
+    for (size_t e = 0; e < numEntries; e++) {
+        char name[3 * SEQ_NAME_SIZE];
+        size_t sequence = entries[e].index;
+        if (2 == length) {
+            sprintf(name, "%s %s", handler_name(sequence / NUM_SEQ_HANDLERS), handler_name(sequence % NUM_SEQ_HANDLERS));
+        } else {
+            sprintf(name, "%s %s %s", handler_name(sequence / NUM_SEQ_HANDLERS / NUM_SEQ_HANDLERS),
+                    handler_name(sequence / NUM_SEQ_HANDLERS % NUM_SEQ_HANDLERS), handler_name(sequence % NUM_SEQ_HANDLERS));
+        }
+        fprintf(report, "%-20s%14llu%8.2f%%\n", name, (unsigned long long) entries[e].count, total ? 100.0 * entries[e].count / total : 0);
+    }
+}
+
+
+
+// Writes instruction counts as folded stacks of opcode then word, for flame graph tools
+int write_folded( Profile *profile, char fileName[] ) {
+    FILE *folded = fopen(fileName, "w");
+    if (NULL == folded) { return PROG_ACC_ERR; }
+
+    for (size_t word = 0; word <= NUM_MEM_WORDS; word++) {
+        if (profile->hits[word]) {
+            fprintf(folded, "TIMS;%s;word_0x%02zx %llu\n", handler_name(profile->handlers[word]), word, (unsigned long long) profile->hits[word]);
+        }
+    }
+
+    return fclose(folded) ? PROG_ACC_ERR : 0;
+}
+
+
+
+// ______________________________
+//       SUPERINSTRUCTIONS
+// ______________________________
+
+
+
+// Runs a program with the hottest sequences fused into superinstructions, chosen from a saved sequence profile,
+// else from the sequences counted over its first FUSE_WARMUP instructions
+// Keeps the machine's instruction limit across the warm-up
+int execute_fused( Machine *vm, Profile *sequences ) {
+    if (NULL != sequences) {
+        vm->fusions = select_fusions(sequences);
+        return execute(vm);
+    }
+
+    Profile *warmup = calloc(1, sizeof(Profile));
+    if (NULL == warmup) { return execute(vm); }
+
+    // Count sequences on the profiling hook, then run on with the fused handlers
+    size_t instrLimit = vm->instrLimit;
+    size_t instrStart = vm->instrCount;
+    vm->profile = warmup;
+    vm->instrLimit = instrLimit && instrLimit < FUSE_WARMUP ? instrLimit : FUSE_WARMUP;
+    int status = execute(vm);
+    vm->profile = NULL;
+    vm->fusions = select_fusions(warmup);
+    free(warmup);
+
+    size_t numRun = vm->instrCount - instrStart;
+    if (INSTR_LIMIT == status && (!instrLimit || numRun < instrLimit)) {
+        vm->instrLimit = instrLimit ? instrLimit - numRun : 0;
+        status = execute(vm);
+    }
+    vm->instrLimit = instrLimit;
+
+    return status;
+}
+
+
+
+// Chooses the superinstructions whose sequences ran often enough to save 1 in FUSE_MIN_SHARE dispatches
+// Returns a bit for each superinstruction of the catalog chosen
+unsigned int select_fusions( Profile *profile ) {
+    size_t total = 0;
+    for (size_t h = 0; h < NUM_SEQ_HANDLERS; h++) {
+        for (size_t next = 0; next < NUM_SEQ_HANDLERS; next++) {
+            total += profile->pairs[h][next];
+        }
+    }
+
+    unsigned int fusions = 0;
+    for (size_t f = 0; f < NUM_FUSIONS; f++) {
+        const int *sequence = fusionCatalog[f].sequence;
+        size_t count = 2 == fusionCatalog[f].length ? profile->pairs[sequence[0]][sequence[1]]
+                : profile->triples[sequence[0]][sequence[1]][sequence[2]];
+        if (count && count * (fusionCatalog[f].length - 1) * FUSE_MIN_SHARE >= total) {
+            fusions |= 1u << f;
+        }
+    }
+
+    return fusions;
+}
+
+
+
+// Returns the first chosen superinstruction whose sequence starts at a word, else the word's own handler
+int fuse_instr( const Decoded cache[], size_t address, unsigned int fusions ) {
+    for (size_t f = 0; f < NUM_FUSIONS; f++) {
+        const Fusion *fusion = &fusionCatalog[f];
+        if (!(fusions & 1u << f) || address + fusion->length > NUM_MEM_WORDS) { continue; }
+
+        size_t i = 0;
+        while (i < fusion->length && cache[address + i].handler == fusion->sequence[i]) {
+            i++;
+        }
+        if (i == fusion->length) { return fusion->handler; }
+    }
+
+    return cache[address].handler;
+}
+
+
+
+// Writes the pairs and triples of a profile, a sequence of handler names and its count a line
+int write_sequences( Profile *profile, char fileName[] ) {
+    FILE *file = fopen(fileName, "w");
+    if (NULL == file) { return PROG_ACC_ERR; }
+
+    for (size_t a = 0; a < NUM_SEQ_HANDLERS; a++) {
+        for (size_t b = 0; b < NUM_SEQ_HANDLERS; b++) {
+            if (profile->pairs[a][b]) {
+                fprintf(file, "%s %s %llu\n", handler_name(a), handler_name(b), (unsigned long long) profile->pairs[a][b]);
+            }
+            for (size_t c = 0; c < NUM_SEQ_HANDLERS; c++) {
+                if (profile->triples[a][b][c]) {
+                    fprintf(file, "%s %s %s %llu\n", handler_name(a), handler_name(b), handler_name(c), (unsigned long long) profile->triples[a][b][c]);
+                }
+            }
+        }
+    }
+
+    return fclose(file) ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Reads the pairs and triples of a sequence profile written by write_sequences() into an empty profile
+int read_sequences( Profile *profile, char fileName[] ) {
+    FILE *file = fopen(fileName, "r");
+    if (NULL == file) { return PROG_ACC_ERR; }
+
+    char line[4 * SEQ_NAME_SIZE + 24];
+    char names[4][SEQ_NAME_SIZE];
+    int status = 0;
+    while (!status && NULL != fgets(line, sizeof(line), file)) {
+        int numFields = sscanf(line, "%15s %15s %15s %15s", names[0], names[1], names[2], names[3]);
+        if (numFields < 1) { continue; }    // Blank line
+        if (numFields < 3) {
+            status = BAD_PROGRAM;
+            break;
+        }
+
+        // Handler names, then the count
+        int handlers[3];
+        for (size_t n = 0; n + 1 < numFields; n++) {
+            handlers[n] = sequence_handler(names[n]);
+            if (handlers[n] < 0) {
+                status = BAD_PROGRAM;
+            }
+        }
+        size_t count = strtoull(names[numFields - 1], NULL, 10);
+        if (status) { break; }
+        if (3 == numFields) {
+            profile->pairs[handlers[0]][handlers[1]] += count;
+        } else {
+            profile->triples[handlers[0]][handlers[1]][handlers[2]] += count;
+        }
+    }
+
+    fclose(file);
+
+    return status;
+}
+
+
+
+// Returns the handler counted in sequences with a name, -1 if none
+int sequence_handler( const char name[] ) {
+    for (int h = 0; h < NUM_SEQ_HANDLERS; h++) {
+        if (!strcmp(handler_name(h), name)) { return h; }
+    }
+
+    return -1;
+}
+
+
+
+// ______________________________
+//             TRACES
+// ______________________________
+
+
+
+// Opens an empty trace, written to the named file on request
+int open_trace( Trace *trace, char fileName[] ) {
+    memset(trace, 0, sizeof(Trace));
+    trace->fileName = fileName;
+    trace->instrPtr = -1;   // First instruction's delta is its address
+    trace->chunks = malloc(TRACE_NUM_CHUNKS * sizeof(TraceChunk));
+
+    return NULL == trace->chunks ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Frees trace storage
+void close_trace( Trace *trace ) {
+    free(trace->chunks);
+    trace->chunks = NULL;
+}
+
+
+
+// Records an instruction about to execute as deltas from the last traced instruction
+void trace_instr( Trace *trace, Memory *mem, size_t address, WORD_TYPE instrWord, WORD_TYPE accumulator ) {
+    unsigned char *record = next_record(trace, mem);
+    size_t length = put_varint(record, ZIGZAG((long int) address - trace->instrPtr - 1) << 1);
+    unsigned short wordDelta = (unsigned short) (instrWord ^ trace->instrReg);  // Fixed width, as words rarely repeat
+    record[length++] = (unsigned char) wordDelta;
+    record[length++] = (unsigned char) (wordDelta >> 8);
+    length += put_varint(&record[length], ZIGZAG(accumulator - trace->accumulator));
+    trace->chunk->key.used += length;
+
+    trace->instrPtr = address;
+    trace->instrReg = instrWord;
+    trace->accumulator = accumulator;
+}
+
+
+
+// Records the new value of a memory word written by the last traced instruction
+void trace_write( Trace *trace, Memory *mem, size_t address ) {
+    unsigned char *record = next_record(trace, mem);
+    size_t length = put_varint(record, (unsigned long) address << 1 | 1);
+    length += put_varint(&record[length], ZIGZAG(mem->words[address]));
+    trace->chunk->key.used += length;
+}
+
+
+
+// Returns room for the next record in the newest chunk, starting another over the oldest when full
+unsigned char *next_record( Trace *trace, Memory *mem ) {
+    TraceChunk *chunk = trace->chunk;
+
+    if (NULL == chunk || chunk->key.used > TRACE_CHUNK_SIZE - TRACE_RECORD_SIZE) {
+        chunk = trace->chunk = &trace->chunks[trace->numChunks++ % TRACE_NUM_CHUNKS];
+        chunk->key.used = 0;
+        chunk->key.instrPtr = trace->instrPtr;
+        chunk->key.instrReg = trace->instrReg;
+        chunk->key.accumulator = trace->accumulator;
+        memcpy(chunk->key.words, mem->words, sizeof(chunk->key.words));
+    }
+
+    return &chunk->records[chunk->key.used];
+}
+
+
+
+// Encodes a value as a varint of 7 bits per byte, low bits first
+// Returns the number of bytes
+size_t put_varint( unsigned char bytes[], unsigned long value ) {
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        bytes[length++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    bytes[length++] = (unsigned char) value;
+
+    return length;
+}
+
+
+
+// Decodes a varint
+// Returns the number of bytes, 0 if it runs past the end
+size_t get_varint( const unsigned char bytes[], size_t length, unsigned long *value ) {
+    *value = 0;
+
+    for (size_t i = 0; i < length && i < TRACE_RECORD_SIZE; i++) {
+        *value |= (unsigned long) (bytes[i] & 0x7f) << 7*i;
+        if (!(bytes[i] & 0x80)) { return i + 1; }
+    }
+
+    return 0;
+}
+
+
+
+// Writes the chunks in the ring buffer to the trace file, oldest first
+int write_trace( Trace *trace ) {
+    FILE *file = fopen(trace->fileName, "wb");
+    if (NULL == file) { return PROG_ACC_ERR; }
+
+    size_t first = trace->numChunks > TRACE_NUM_CHUNKS ? trace->numChunks - TRACE_NUM_CHUNKS : 0;
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.numChunks = trace->numChunks - first;
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (size_t c = first; c < trace->numChunks; c++) {
+        TraceChunk *chunk = &trace->chunks[c % TRACE_NUM_CHUNKS];
+        fwrite(&chunk->key, sizeof(TraceKeyframe), 1, file);
+        fwrite(chunk->records, 1, chunk->key.used, file);
+    }
+
+    return fclose(file) ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Re-runs a trace from the memory image of its oldest chunk, taking stored words from the trace
+// Each instruction is checked against the traced instruction pointer, word and accumulator
+int replay_trace( char fileName[], Channel *output ) {
+    size_t traceLen = 0;
+    char *contents = read_file(fileName, &traceLen);
+    if (NULL == contents) { return PROG_ACC_ERR; }
+
+    TraceHeader header;
+    if (traceLen < sizeof(header)) {
+        free(contents);
+        return BAD_TRACE;
+    }
+    memcpy(&header, contents, sizeof(header));
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) || TRACE_VERSION != header.version) {
+        free(contents);
+        return BAD_TRACE;
+    }
+
+    Memory mem;
+    memset(&mem, 0, sizeof(Memory));
+    Decoded instr;
+    long int instrPtr = 0;      // Last replayed instruction
+    WORD_TYPE instrReg = 0;
+    WORD_TYPE accumulator = 0;
+    size_t expected = 0;        // Instruction that should follow
+    size_t numInstr = 0;
+    int done = 0;
+    int status = 0;
+
+    char *chunkStart = contents + sizeof(header);
+    for (size_t c = 0; !done && !status && c < header.numChunks; c++) {
+        TraceKeyframe key;
+        if (chunkStart + sizeof(key) > contents + traceLen) {
+            status = BAD_TRACE;
+            break;
+        }
+        memcpy(&key, chunkStart, sizeof(key));
+        const unsigned char *records = (unsigned char *) chunkStart + sizeof(key);
+        chunkStart += sizeof(key) + key.used;
+        if (chunkStart > contents + traceLen) {
+            status = BAD_TRACE;
+            break;
+        }
+
+        // Start from the oldest keyframe, and check the rest agree with the replay
+        // Memory is checked at the first instruction, as a chunk may start with stores already in its keyframe
+        int checkKey = 0 != c;
+        if (!c) {
+            memcpy(mem.words, key.words, sizeof(mem.words));
+            instrPtr = key.instrPtr;
+            instrReg = key.instrReg;
+            accumulator = key.accumulator;
+        } else if (instrPtr != key.instrPtr || instrReg != key.instrReg || accumulator != key.accumulator) {
+            status = BAD_TRACE;
+            break;
+        }
+
+        for (size_t pos = 0; !done && !status && pos < key.used; ) {
+            unsigned long tag, value;
+            size_t length = get_varint(&records[pos], key.used - pos, &tag);
+            pos += length;
+            if (!length) {
+                status = BAD_TRACE;
+                break;
+            }
+
+            // Store by the last instruction
+            if (tag & 1) {
+                length = get_varint(&records[pos], key.used - pos, &value);
+                pos += length;
+                if (!length || tag >> 1 >= NUM_MEM_WORDS) {
+                    status = BAD_TRACE;
+                } else {
+                    mem.words[tag >> 1] = (WORD_TYPE) UNZIGZAG(value);
+                }
+                continue;
+            }
+
+            // Next instruction
+            if (checkKey && memcmp(mem.words, key.words, sizeof(mem.words))) {
+                status = BAD_TRACE;
+                break;
+            }
+            checkKey = 0;
+            length = pos + 2 < key.used ? get_varint(&records[pos + 2], key.used - pos - 2, &value) : 0;
+            if (!length) {
+                status = BAD_TRACE;
+                break;
+            }
+            instrPtr += 1 + UNZIGZAG(tag >> 1);
+            instrReg ^= (WORD_TYPE) (records[pos] | records[pos + 1] << 8);
+            accumulator += (WORD_TYPE) UNZIGZAG(value);
+            pos += 2 + length;
+
+            if (instrPtr < 0 || instrPtr > NUM_MEM_WORDS || (numInstr && instrPtr != expected)
+                    || instrReg != (instrPtr < NUM_MEM_WORDS ? mem.words[instrPtr] : 0)) {
+                format_channel(output, "\nInstruction %zu - trace diverges at word %ld\n\n", numInstr + 1, instrPtr);
+                status = BAD_TRACE;
+                break;
+            }
+            numInstr++;
+
+            if (instrPtr < NUM_MEM_WORDS) {
+                decode_instr(&mem, instrPtr, &instr, NULL);
+            } else {
+                instr.handler = H_BAD_ADDR;
+            }
+            expected = instrPtr + 1;
+            switch (instr.handler) {
+                case H_PRTI:    // Reprint output, stored input follows as writes
+                    write_int(output, mem.words[instr.operand]);
+                    break;
+                case H_PRTS:
+                    write_string(output, &mem, instr.operand);
+                    break;
+                case H_B:
+                    expected = instr.target;
+                    break;
+                case H_BN:
+                    expected = accumulator < 0 ? instr.target : expected;
+                    break;
+                case H_BZ:
+                    expected = !accumulator ? instr.target : expected;
+                    break;
+                case H_BAD_ADDR:
+                    format_channel(output, "\nWord %ld - invalid memory address\n\n", instrPtr);
+                    done = 1;
+                    break;
+                case H_END:
+                    done = 1;
+                    break;
+            }
+        }
+    }
+
+    if (flush_channel(output) && !status) {
+        status = PROG_ACC_ERR;
+    }
+    free(contents);
+
+    if (status) {
+        printf("\nFailed to replay trace \"%s\"\n\n", fileName);
+    } else {
+        printf("\nReplayed %zu instructions from trace \"%s\"\n\n", numInstr, fileName);
+    }
+
+    return status;
+}
+
+
+
+// Requests the execution trace be written at the next poll
+void request_trace( int sig ) {
+    traceRequest = 1;
+    signal(sig, request_trace);     // Re-arm for systems that reset handlers
+}
+
+
+
+// ______________________________
+//           DEBUGGER
+// ______________________________
+
+
+
+// Runs a machine under the debugger, stopping before its first instruction and at each breakpoint,
+// watchpoint and finished step to read commands, one a line:
+//   b ADDR, d ADDR     set, delete a breakpoint
+//   w ADDR, u ADDR     watch, unwatch a word
+//   s [N]              step N instructions, 1 by default
+//   c                  continue to a breakpoint, watchpoint or END
+//   r                  show the registers
+//   m ADDR [N]         show N words from ADDR, 1 by default
+//   q                  stop the program where it is
+// Addresses are decimal, or hex with 0x. Once commands run out the program runs on to END undebugged
+// Returns the program's status as execute() would, INSTR_LIMIT if stopped by q
+int debug_machine( Machine *vm, Debugger *debugger ) {
+    char line[DEBUG_LINE_SIZE];
+    char command = '\0';
+    long int first = 0;
+    long int second = 0;
+    int status = INSTR_LIMIT;
+
+    vm->debugger = debugger;
+    printf("Debugging from word 0x%02zx\n", vm->instrPtr);
+    debug_words(vm, vm->instrPtr, 1);
+
+    while (1) {
+        printf("(tims) ");
+        fflush(stdout);
+        if (NULL == fgets(line, sizeof(line), debugger->commands)) {    // Out of commands
+            putchar('\n');
+            vm->debugger = NULL;
+            vm->instrLimit = 0;
+            return execute(vm);
+        }
+        second = 1;
+        int numFields = sscanf(line, " %c %li %li", &command, &first, &second);
+        if (numFields < 1) { continue; }
+        int hasAddress = numFields > 1 && first >= 0 && first < NUM_MEM_WORDS;
+
+        switch (command) {
+            case 'b':
+            case 'd':
+                if (!hasAddress) { break; }
+                if ('b' == command) {
+                    debugger->breakpoints[first / 8] |= 1 << first % 8;
+                } else {
+                    debugger->breakpoints[first / 8] &= ~(1 << first % 8);
+                }
+                continue;
+            case 'w':
+            case 'u':
+                if (!hasAddress) { break; }
+                if (!DEBUG_BIT(debugger->watchpoints, first) == ('w' == command)) {
+                    debugger->watchpoints[first / 8] ^= 1 << first % 8;
+                    debugger->numWatchpoints += 'w' == command ? 1 : -1;
+                }
+                continue;
+            case 'r':
+                printf("%-24s0x%02zx\n", "Instruction Pointer", vm->instrPtr);
+                printf("%-22s0x%04x\n", "Instruction Register", vm->instrReg & 0xffff);
+                printf("%-22s0x%04x\n", "Accumulator", vm->accumulator & 0xffff);
+                printf("%-24s%zu\n", "Instructions", vm->instrCount);
+                continue;
+            case 'm':
+                if (!hasAddress) { break; }
+                debug_words(vm, first, second > 0 ? second : 1);
+                continue;
+            case 'q':
+                vm->debugger = NULL;
+                return INSTR_LIMIT;
+            case 's':
+            case 'c':
+                status = debug_run(vm, 'c' == command ? 0 : numFields > 1 && first > 0 ? first : 1);
+                break;
+        }
+
+        // Report why the program stopped, or end the session with it
+        switch (status) {
+            case BREAKPOINT:
+                printf("Breakpoint at word 0x%02zx\n", vm->instrPtr);
+                break;
+            case WATCHPOINT:
+                printf("Watched word 0x%02zx now %d\n", debugger->watchHit, vm->mem.words[debugger->watchHit]);
+                break;
+            case INSTR_LIMIT:
+                if ('s' != command && 'c' != command) {
+                    puts("Commands: b ADDR, d ADDR, w ADDR, u ADDR, s [N], c, r, m ADDR [N], q");
+                    continue;
+                }
+                break;
+            default:
+                vm->debugger = NULL;
+                return status;
+        }
+        debug_words(vm, vm->instrPtr, 1);
+        status = INSTR_LIMIT;
+    }
+}
+
+
+
+// Runs a debugged machine for a number of instructions, or until it stops if 0
+// A breakpoint at the instruction pointer is stepped over first, so continuing leaves it
+int debug_run( Machine *vm, size_t numSteps ) {
+    Debugger *debugger = vm->debugger;
+    size_t ip = vm->instrPtr;
+    int status = 0;
+
+    if (ip < NUM_MEM_WORDS && DEBUG_BIT(debugger->breakpoints, ip)) {
+        debugger->breakpoints[ip / 8] &= ~(1 << ip % 8);
+        vm->instrLimit = 1;
+        status = execute(vm);
+        debugger->breakpoints[ip / 8] |= 1 << ip % 8;
+        if (INSTR_LIMIT != status || 1 == numSteps) { return status; }
+        numSteps -= 0 != numSteps;
+    }
+
+    vm->instrLimit = numSteps;
+    status = execute(vm);
+    vm->instrLimit = 0;
+
+    return status;
+}
+
+
+
+// Returns whether any base memory word from first up to last is watched, noting the first that is
+int watch_hit( Debugger *debugger, size_t first, size_t last ) {
+    for (size_t address = first; address < last && address < NUM_MEM_WORDS; address++) {
+        if (DEBUG_BIT(debugger->watchpoints, address)) {
+            debugger->watchHit = address;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+// Prints memory words as the instructions they decode to, marking breakpoints and watched words
+void debug_words( Machine *vm, size_t address, size_t count ) {
+    size_t limit = NULL == vm->mem.pages ? NUM_MEM_WORDS : EXT_NUM_WORDS;
+    Decoded instr;
+
+    for (; count && address < limit; address++, count--) {
+        WORD_TYPE word = read_word(&vm->mem, address);
+        decode_fields(word, 0, limit, &instr);
+        int marked = address < NUM_MEM_WORDS && NULL != vm->debugger;
+        printf("%c%c 0x%02zx: 0x%04x %6d  %s", marked && DEBUG_BIT(vm->debugger->breakpoints, address) ? 'b' : ' ',
+                marked && DEBUG_BIT(vm->debugger->watchpoints, address) ? 'w' : ' ', address, word & 0xffff, word, handler_name(instr.handler));
+        if (H_NOP != instr.handler && H_END != instr.handler) {
+            printf(" 0x%02zx", instr.target);
+        }
+        putchar('\n');
+    }
+}
+
+
+
+// ______________________________
+//          I/O CHANNELS
+// ______________________________
+
+
+
+// Opens a buffered channel on a file, pipe or terminal stream
+int open_channel( Channel *channel, FILE *file ) {
+    memset(channel, 0, sizeof(Channel));
+    channel->file = file;
+    channel->data = malloc(CHANNEL_BUFFER_SIZE);
+
+    return NULL == channel->data ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Flushes any buffered output and frees the channel buffer
+// The stream is left open
+int close_channel( Channel *channel ) {
+    int status = flush_channel(channel);
+    free(channel->data);
+    channel->data = NULL;
+
+    return status;
+}
+
+
+
+// Refills an input channel once all buffered input has been read
+// Returns the number of bytes buffered, 0 at end of input
+size_t fill_channel( Channel *channel ) {
+    if (channel->start < channel->length) { return channel->length - channel->start; }
+    if (channel->eof) { return 0; }
+
+    if (NULL != channel->tie) {     // Show pending output before waiting on input
+        flush_channel(channel->tie);
+    }
+
+    channel->start = 0;
+#ifdef __unix__
+    // Take whatever is available, so terminals and pipes don't wait for a full buffer
+    ssize_t numRead = read(fileno(channel->file), channel->data, CHANNEL_BUFFER_SIZE);
+    channel->length = numRead > 0 ? numRead : 0;
+    channel->writerPending &= !channel->length;
+    // Non-blocking input yet to arrive isn't the end
+    channel->eof = !channel->length && !(channel->nonblocking
+            && (channel->writerPending || (numRead < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))));
+#else
+    // Read at most a line, so terminals don't wait for a full buffer
+    channel->length = NULL == fgets(channel->data, CHANNEL_BUFFER_SIZE, channel->file) ? 0 : strlen(channel->data);
+    channel->eof = !channel->length;
+#endif
+
+    return channel->length;
+}
+
+
+
+// Writes out buffered channel output
+int flush_channel( Channel *channel ) {
+    if (channel->length && fwrite(channel->data, 1, channel->length, channel->file) != channel->length) {
+        channel->error = 1;
+    }
+    channel->length = 0;
+    if (fflush(channel->file)) {
+        channel->error = 1;
+    }
+
+    return channel->error ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Reads a decimal integer from a channel, skipping leading whitespace
+// Returns true if an integer was read, else value is unchanged and the offending byte left unread
+int read_int( Channel *channel, int *value ) {
+    // Skip whitespace
+    while (fill_channel(channel) && isspace((unsigned char) channel->data[channel->start])) {
+        channel->start++;
+    }
+    if (!fill_channel(channel)) { return 0; }
+
+    int negative = '-' == channel->data[channel->start];
+    if (negative || '+' == channel->data[channel->start]) {
+        channel->start++;
+    }
+
+    // Accumulate digits, refilling if the number spans buffers
+    unsigned int number = 0;
+    size_t numDigits = 0;
+    while (fill_channel(channel)) {
+        size_t digit = channel->start;
+        while (digit < channel->length && isdigit((unsigned char) channel->data[digit])) {
+            number = 10*number + (channel->data[digit++] - '0');
+        }
+        numDigits += digit - channel->start;
+        channel->start = digit;
+        if (digit < channel->length) { break; }     // Non-digit follows
+    }
+    if (!numDigits) { return 0; }
+
+    *value = negative ? -(int) number : (int) number;
+
+    return 1;
+}
+
+
+
+// Reads a line from a channel, without its newline, to at most size bytes
+// The rest of a longer line is discarded
+// Returns the number of bytes stored, which are not NUL-terminated
+size_t read_line( Channel *channel, char line[], size_t size ) {
+    size_t length = 0;
+
+    while (fill_channel(channel)) {
+        char *start = &channel->data[channel->start];
+        size_t available = channel->length - channel->start;
+        char *newline = memchr(start, '\n', available);
+        size_t lineBytes = NULL == newline ? available : (size_t) (newline - start);
+
+        size_t stored = lineBytes < size - length ? lineBytes : size - length;
+        memcpy(&line[length], start, stored);
+        length += stored;
+
+        channel->start += lineBytes;
+        if (NULL != newline) {
+            channel->start++;   // Consume newline
+            break;
+        }
+    }
+
+    return length;
+}
+
+
+
+// Writes bytes to a channel, writing out the buffer whenever full
+void write_bytes( Channel *channel, const char bytes[], size_t length ) {
+    if (length > CHANNEL_BUFFER_SIZE - channel->length) {
+        flush_channel(channel);
+    }
+    if (length > CHANNEL_BUFFER_SIZE) {     // Too large to buffer
+        if (fwrite(bytes, 1, length, channel->file) != length) {
+            channel->error = 1;
+        }
+        return;
+    }
+
+    memcpy(&channel->data[channel->length], bytes, length);
+    channel->length += length;
+}
+
+
+
+// Writes a decimal integer and newline to a channel
+void write_int( Channel *channel, int value ) {
+    char digits[3*sizeof(int) + 2];     // Sign, digits and newline
+    char *digit = &digits[sizeof(digits)];
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+
+    *--digit = '\n';
+    do {
+        *--digit = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        *--digit = '-';
+    }
+
+    write_bytes(channel, digit, &digits[sizeof(digits)] - digit);
+}
+
+
+
+// Writes a string and newline from memory to a channel, stopping at NUL or the end of memory
+void write_string( Channel *channel, Memory *mem, size_t address ) {
+    char *string = (char *) &mem->words[address];
+    size_t length = (NUM_MEM_WORDS - address) * sizeof(WORD_TYPE);
+    char *end = memchr(string, '\0', length);
+    if (NULL != end) {
+        length = end - string;
+    }
+
+    write_bytes(channel, string, length);
+    write_bytes(channel, "\n", 1);
+}
+
+
+
+// Writes printf-formatted text to a channel
+void format_channel( Channel *channel, const char format[], ... ) {
+    char text[FORMAT_BUFFER_SIZE];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length > 0) {
+        write_bytes(channel, text, (size_t) length < sizeof(text) ? (size_t) length : sizeof(text) - 1);
+    }
+}
+
+
+
+// Takes whatever input has arrived on a non-blocking channel, then checks it holds a whole integer or line to read
+// A full buffer or exhausted input count as ready, as waiting wouldn't complete them
+// Returns true if RDI or RDS can read without waiting
+int channel_ready( Channel *channel, int handler ) {
+#ifdef __unix__
+    // Append to the unread input
+    if (channel->start) {
+        memmove(channel->data, &channel->data[channel->start], channel->length - channel->start);
+        channel->length -= channel->start;
+        channel->start = 0;
+    }
+    if (!channel->eof && channel->length < CHANNEL_BUFFER_SIZE) {
+        ssize_t numRead = read(fileno(channel->file), &channel->data[channel->length], CHANNEL_BUFFER_SIZE - channel->length);
+        if (numRead > 0) {
+            channel->length += numRead;
+            channel->writerPending = 0;
+        } else if (numRead || !channel->writerPending) {   // A FIFO with no writer yet reads nothing
+            channel->eof = !numRead || (EAGAIN != errno && EWOULDBLOCK != errno);
+        }
+    }
+    if (channel->eof || CHANNEL_BUFFER_SIZE == channel->length) { return 1; }
+
+    if (H_RDS == handler) {
+        return NULL != memchr(channel->data, '\n', channel->length);
+    }
+
+    // An integer ends at the first byte after its whitespace, sign and digits
+    char *byte = channel->data;
+    char *end = &channel->data[channel->length];
+    while (byte < end && isspace((unsigned char) *byte)) {
+        byte++;
+    }
+    if (byte < end && ('-' == *byte || '+' == *byte)) {
+        byte++;
+    }
+    while (byte < end && isdigit((unsigned char) *byte)) {
+        byte++;
+    }
+
+    return byte < end;
+#else
+    (void) channel;
+    (void) handler;
+    return 1;   // Reads wait as usual
+#endif
+}
+
+
+
+// ______________________________
+//            ASSEMBLY
+// ______________________________
+
+
+
+// Names the object file of a source, "Asm" inserted before the extension
+// The source name must leave room for the 3 more characters
+void object_name( char objectName[], const char sourceName[] ) {
+    const char *baseName = strrchr(sourceName, '/');
+    const char *extension = strrchr(NULL == baseName ? sourceName : baseName, '.');
+    if (NULL == extension) {
+        extension = &sourceName[strlen(sourceName)];
+    }
+    sprintf(objectName, "%.*sAsm%s", (int) (extension - sourceName), sourceName, extension);
+}
+
+
+
+// Assembles a TIMS programs in a single pass to a relocatable object file
+// Forward label references are recorded as fixups and patched once the whole program is read
+// References to labels the program doesn't define are left for the linker
+// Shares no state between calls, so programs can be assembled on several threads, each with its own log
+int assemble_program( char fileName[], char *mnemonics[], WORD_TYPE opcodes[], int optimize, FILE *log ) {
+    if (strlen(fileName) + 3 >= PATH_SIZE) { return PROG_ACC_ERR; }
+    char programName[PATH_SIZE];
+    strcpy(programName, fileName);  // Copy program name
+
+    char assembledName[PATH_SIZE];
+    object_name(assembledName, programName);
+
+    strcpy(fileName, assembledName);    // Return output file name in fileName[]
+
+    size_t sourceLen = 0;
+    char *source = read_file(programName, &sourceLen);  // Read whole program
+    if (NULL == source) { return PROG_ACC_ERR; }
+
+    Arena arena = {NULL};   // Symbol table storage
+    SymbolTable symbols;
+    // Assembled words and their relocations, large enough for a string spanning the whole source
+    WORD_TYPE *words = malloc((sourceLen / 2 + 1) * sizeof(WORD_TYPE));
+    unsigned char *code = calloc(sourceLen / 2 + 1, 1);     // Words assembled from instructions
+    RelocTable relocs = {malloc((sourceLen / 2 + 1) * sizeof(unsigned short)), 0};
+    if (NULL == words || NULL == code || NULL == relocs.offsets || init_symbols(&symbols, &arena)) {
+        free(relocs.offsets);
+        free(code);
+        free(words);
+        free(source);
+        free_arena(&arena);
+        return PROG_ACC_ERR;
+    }
+
+    size_t lineNum = 1;
+    size_t address = 0;     // Word address of next assembled word
+    unsigned int numErrors = 0;
+
+    // Assemble every program line
+    for (char *line = source; line < source + sourceLen; lineNum++) {
+        char *lineEnd = memchr(line, '\n', source + sourceLen - line);
+        if (NULL == lineEnd) {
+            lineEnd = source + sourceLen;
+        }
+
+        int asmWords = assemble_instruction(&words[address], &code[address], line, lineEnd - line, mnemonics, opcodes, &symbols, &relocs, address, lineNum);
+        line = lineEnd + 1;     // Next line
+
+        switch (asmWords) {
+            case 0: // Skip blank lines
+                continue;
+            case INV_INSTR: // Invalid instruction
+                if (NULL != log) {
+                    fprintf(log, "Line %zu - invalid instruction\n", lineNum);
+                }
+                numErrors++;
+                continue;
+            case INV_STR:   // Invalid string literal
+                if (NULL != log) {
+                    fprintf(log, "Line %zu - invalid string\n", lineNum);
+                }
+                numErrors++;
+                continue;
+        }
+
+        address += asmWords;
+        symbols.pendingLabel = NULL;    // Any lone label now has an instruction
+    }
+
+    if (NULL != symbols.pendingLabel && NULL != log) {  // Warning for dangling labels
+        fprintf(log, "Warning: Line %zu - dangling label \"%.*s\" ignored\n", symbols.pendingLine,
+                (int) symbols.pendingLabel->name.length, symbols.pendingLabel->name.start);
+    }
+
+    patch_fixups(&symbols, words, &relocs);     // Resolve forward references
+
+    if (!numErrors && optimize) {
+        optimize_program(programName, words, &address, code, &relocs, &symbols, log);
+    }
+    if (!numErrors && write_object(assembledName, words, address, &relocs, &symbols, optimize)) {
+        numErrors++;
+    }
+
+    free_arena(&arena);
+    free(relocs.offsets);
+    free(code);
+    free(words);
+    free(source);   // Labels reference the source, so free it last
+
+    if (numErrors) {
+        if (NULL != log) {
+            fprintf(log, "\nFailed to assemble \"%s\": %u errors contained\n\n", programName, numErrors);
+        }
+        return BAD_PROGRAM;
+    } else {
+        if (NULL != log) {
+            fprintf(log, "\nAssembled \"%s\" to \"%s\"\n\n", programName, assembledName);
+        }
+        return 0;
+    }
+}
+
+
+
+// Reads a whole file into one NUL-terminated block
+// Returns the block, to be freed by the caller, or NULL on failure
+char *read_file( char fileName[], size_t *length ) {
+    FILE *file = fopen(fileName, "rb");     // Open file
+    if (NULL == file) { return NULL; }
+
+    fseek(file, 0, SEEK_END);
+    long int fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *contents = fileSize < 0 ? NULL : malloc(fileSize + 1);
+    if (NULL == contents) {
+        fclose(file);
+        return NULL;
+    }
+
+    *length = fread(contents, 1, fileSize, file);   // Read in one block
+    contents[*length] = '\0';
+
+    fclose(file);
+
+    return contents;
+}
+
+
+
+// Assemble TIMS assembly instruction to TIMS instruction word
+// Defines any label at the given word address and records references to undefined labels as fixups
+// Instructions with address operands are recorded for relocation, and instruction words are marked as code
+// Returns the number of instruction words assembled (multiple if string or address prefixed)
+int assemble_instruction( WORD_TYPE *instrWord, unsigned char code[], const char line[], size_t length, char *mnenonics[], WORD_TYPE opcodes[], SymbolTable *symbols, RelocTable *relocs, size_t address, size_t lineNum ) {
+    // Split instruction into components and determine format
+    Token components[3];
+    int format = tokenize_line(line, length, components);
+
+    // Define label at the address of this line's first word
+    if ((BLK != format && INV_INSTR != format && INV_STR != format) && components[0].length) {
+        Label *label = define_label(symbols, components[0], address);
+        if (NULL == label) { return INV_INSTR; }
+        if (L__ == format) {    // Lone label waits for the next instruction
+            symbols->pendingLabel = label;
+            symbols->pendingLine = lineNum;
+        }
+    }
+
+    int opcode = 0x0;
+    int operand = 0x0;
+    size_t numStrWordsAsm = 0;
+    const char *string = components[1].start;
+    // Assemble instruction word
+    switch (format) {
+        case _IR_:  // Instruction, reference operand
+            opcode = get_opcode(components[1], mnenonics, opcodes);
+            if (NO_OPCODE == opcode) { return INV_INSTR; }  // Invalid command error
+            operand = resolve_label(components[2], symbols);
+            if (NO_LABEL == operand) {  // Forward reference, patched after assembly
+                if (add_fixup(symbols, components[2], address, (WORD_TYPE) (opcode * 0x100), lineNum)) { return INV_INSTR; }
+                operand = 0x0;
+            } else if (END != opcode) {
+                relocs->offsets[relocs->count++] = address;
+            }
+            instrWord[0] = (WORD_TYPE) (opcode * 0x100 + operand);
+            code[0] = 1;
+            return 1;
+        case _IL_:  // Instruction, operand literal
+            operand = parse_literal(components[2]);
+            opcode = get_opcode(components[1], mnenonics, opcodes);
+            if (NO_OPCODE == opcode) { return INV_INSTR; }  // Invalid command error
+            if (operand > 0xff && END != opcode) {  // Wide literals are absolute extended addresses
+                if (operand >= EXT_NUM_WORDS) { return INV_INSTR; }
+                size_t numPrefixes = operand > 0xffff ? 2 : 1;
+                for (size_t prefix = 0; prefix < numPrefixes; prefix++) {
+                    instrWord[prefix] = (WORD_TYPE) (EXT * 0x100 + (operand >> 8 * (numPrefixes - prefix) & 0xff));
+                    code[prefix] = 1;
+                }
+                instrWord[numPrefixes] = (WORD_TYPE) (opcode * 0x100 + (operand & 0xff));
+                code[numPrefixes] = 1;
+                return numPrefixes + 1;
+            }
+            if (END != opcode) {    // Literal operands are program addresses too
+                relocs->offsets[relocs->count++] = address;
+            }
+            instrWord[0] = (WORD_TYPE) (opcode * 0x100 + operand);
+            code[0] = 1;
+            return 1;
+        case _I_:   // No-operand instruction
+            opcode = get_opcode(components[1], mnenonics, opcodes);
+            if (NO_OPCODE == opcode) { return INV_INSTR; }  // Invalid command error
+            instrWord[0] = (WORD_TYPE) opcode * 0x100;
+            code[0] = 1;
+            return 1;
+        case _D_:   // Data word
+            instrWord[0] = (WORD_TYPE) parse_literal(components[1]);
+            return 1;
+        case _S_:   // String data, two characters per word and NUL padded
+            for (numStrWordsAsm = 0; numStrWordsAsm < (components[1].length + 1) / 2; numStrWordsAsm++) {
+                char high = 2*numStrWordsAsm + 1 < components[1].length ? string[2*numStrWordsAsm + 1] : '\0';
+                instrWord[numStrWordsAsm] = (WORD_TYPE) (high * 0x100 + string[2*numStrWordsAsm]);
+            }
+            return numStrWordsAsm;
+        case INV_STR:   // Invalid string literal
+            instrWord[0] = (WORD_TYPE) 0x0;
+            return INV_STR;
+        case BLK:   // Ignore blank lines
+        case L__:
+            return 0;
+        default:    // Unrecognized format
+            instrWord[0] = (WORD_TYPE) 0x0;
+            return INV_INSTR;
+    }
+}
+
+
+
+// Returns the value of a hexadecimal, octal or decimal literal
+int parse_literal( Token literal ) {
+    // Literals are always followed by a non-digit in the source, so strtol stops at the token end
+    if (literal.length > 2 && '0' == literal.start[0] && 'X' == toupper(literal.start[1])) {
+        return strtol(&literal.start[2], NULL, 16); // Hexadecimal literal
+    } else if (1 == literal.length && '0' == literal.start[0]) {
+        return strtol(literal.start, NULL, 8);  // Octal literal
+    } else {
+        return strtol(literal.start, NULL, 10); // Decimal literal
+    }
+}
+
+
+
+// Returns the TIMS opcode of the given mnemonic, matched without regard to case
+// Candidates are selected by length and distinguishing character, then confirmed against the table
+int get_opcode( Token mnemonic, char *mnemonics[], WORD_TYPE opcodes[] ) {
+    size_t instr = NUM_INSTR;   // Candidate mnemonic table index
+    char last = toupper(mnemonic.start[mnemonic.length - 1]);
+
+    switch (mnemonic.length) {
+        case 1:
+            instr = 4;  // B
+            break;
+        case 2:
+            instr = 'N' == last ? 5 : 6;    // BN, BZ
+            break;
+        case 3:
+            switch (toupper(mnemonic.start[0])) {
+                case 'E':   instr = 7;  break;  // END
+                case 'A':   instr = 10; break;  // ADD
+                case 'S':   instr = 11; break;  // SUB
+                case 'C':   instr = 17; break;  // CAS
+                default:    instr = 'I' == last ? 0 : 1;    // RDI, RDS
+            }
+            break;
+        case 4:
+            switch (toupper(mnemonic.start[0])) {
+                case 'P':   instr = 'I' == last ? 2 : 3;    break;  // PRTI, PRTS
+                case 'L':   instr = 8;  break;  // LOAD
+                case 'F':   instr = 18; break;  // FADD
+                case 'W':   instr = 19; break;  // WAIT
+                case 'B':   // BCPY, BFIL, BCMP, BSCH, BADD
+                    switch (toupper(mnemonic.start[2])) {
+                        case 'P':   instr = 12; break;
+                        case 'I':   instr = 13; break;
+                        case 'M':   instr = 14; break;
+                        case 'C':   instr = 15; break;
+                        case 'D':   instr = 16; break;
+                    }
+                    break;
+            }
+            break;
+        case 5:
+            instr = 9;  // STORE
+            break;
+    }
+
+    if (NUM_INSTR == instr || !token_equals(mnemonic, mnemonics[instr])) {
+        return NO_OPCODE;   // No match
+    }
+    return opcodes[instr];
+}
+
+
+
+// Returns true if a token matches a string without regard to case
+int token_equals( Token token, const char string[] ) {
+    for (size_t i = 0; i < token.length; i++) {
+        if ('\0' == string[i] || toupper(token.start[i]) != toupper(string[i])) { return 0; }
+    }
+    return '\0' == string[token.length];
+}
+
+
+
+// Returns the next whitespace-separated token starting at or after start and before end
+// The returned token is empty if none remain
+Token next_token( const char *start, const char *end ) {
+    Token token = {end, 0};
+
+    while (start < end && isspace((unsigned char) *start)) {    // Skip leading whitespace
+        start++;
+    }
+    token.start = start;
+    while (start < end && !isspace((unsigned char) *start)) {   // Measure token
+        start++;
+    }
+    token.length = start - token.start;
+
+    return token;
+}
+
+
+
+// Splits a TIMS instruction line into label and instruction components
+// Components are views into the line, which is not modified
+// String literal contents are returned in components[1]
+// Returns instruction format of line
+int tokenize_line( const char line[], size_t length, Token components[3] ) {
+    const char *end = line + length;
+    const char *quote = memchr(line, '"', length);
+    const char *colon = memchr(line, ':', NULL == quote ? length : (size_t) (quote - line));
+
+    // Label is the first token before any colon
+    components[0].start = line;
+    components[0].length = 0;
+    if (NULL != colon) {
+        components[0] = next_token(line, colon);
+    }
+
+    // If opening quotes
+    if (NULL != quote) {
+        const char *close = memchr(quote + 1, '"', end - quote - 1);
+        if (NULL == close) { return INV_STR; }  // Invalid string
+
+        components[1].start = quote + 1;    // String contents
+        components[1].length = close - quote - 1;
+        return _S_;
+    }
+
+    // Separate remaining components
+    const char *rest = NULL == colon ? line : colon + 1;
+    unsigned int componentNum = 0;
+    for (Token token = next_token(rest, end); token.length; token = next_token(rest, end)) {
+        if (componentNum == 2) { return INV_INSTR; }    // Unrecognized instruction format
+        components[++componentNum] = token;
+        rest = token.start + token.length;
+    }
+
+    // Determine instruction format
+    switch (componentNum) {
+        case 0:
+            if (components[0].length) {
+                return L__; // Label only
+            } else {
+                return BLK; // Blank line
+            }
+        case 1:
+            if (isdigit((unsigned char) components[1].start[0])) {
+                return _D_; // Data word
+            } else {
+                return _I_; // No-operand instruction
+            }
+        default:
+            if (isdigit((unsigned char) components[2].start[0])) {
+                return _IL_;    // Instruction with operand literal
+            } else {
+                return _IR_;    // Instruction with reference operand
+            }
+    }
+}
+
+
+
+// ______________________________
+//           OPTIMIZER
+// ______________________________
+
+
+
+// Optimizes an assembled program in place before it is written out, reporting what it saved
+// Threads branches through branches they're known to take, drops conditional branches never taken
+// and branches to the next word, then drops unreachable code and compacts the program,
+// relocating every address operand, label and external reference to match
+// Labels are exported, so labeled code counts as reachable, and code read as data is never changed
+// Programs storing to code, using bulk parameter blocks or address prefixes, or running into data are left as assembled
+// Returns nonzero if working storage can't be had, leaving the program unchanged
+int optimize_program( char programName[], WORD_TYPE words[], size_t *numWords, unsigned char code[], RelocTable *relocs, SymbolTable *symbols, FILE *log ) {
+    size_t n = *numWords;
+    unsigned char *flags = calloc(n + 1, 1);
+    size_t *newAddr = malloc((n + 1) * sizeof(size_t));
+    size_t *pending = malloc((n + 1) * sizeof(size_t));     // Words to visit, one push per flow edge at most
+    if (NULL == flags || NULL == newAddr || NULL == pending) {
+        free(pending);
+        free(newAddr);
+        free(flags);
+        return PROG_ACC_ERR;
+    }
+
+    // Mark labels and references left for the linker
+    for (size_t slot = 0; slot < symbols->capacity; slot++) {
+        if (symbols->slots[slot].name.length && symbols->slots[slot].address < n) {
+            flags[symbols->slots[slot].address] |= OPT_LABELED;
+        }
+    }
+    for (Fixup *fixup = symbols->fixups; NULL != fixup; fixup = fixup->next) {
+        if (NO_LABEL == resolve_label(fixup->name, symbols)) {
+            flags[fixup->address] |= OPT_EXTERN;
+        }
+    }
+
+    // Pin code read as data, and find what the pass can't follow
+    const char *unchanged = n && !code[0] ? "starts with data" : NULL;
+    for (size_t i = 0; NULL == unchanged && i < n; i++) {
+        if (!code[i] || (flags[i] & OPT_EXTERN)) { continue; }
+
+        WORD_TYPE opcode = words[i] / 0x100;
+        size_t operand = words[i] % 0x100;
+        int writes = RDI == opcode || RDS == opcode || STORE == opcode || CAS == opcode || FADD == opcode;
+        size_t last = CAS == opcode ? operand + 1 : operand;    // Last word accessed
+        switch (opcode) {
+            case END:
+                continue;
+            case EXT:
+                unchanged = "address prefixes";
+                continue;
+            case BCPY:
+            case BFIL:
+            case BCMP:
+            case BSCH:
+            case BADD:
+                unchanged = "bulk parameter blocks";
+                continue;
+            case B:
+            case BN:
+            case BZ:
+                unchanged = operand >= n ? "operands outside the program" : !code[operand] ? "branches into data" : NULL;
+                continue;
+            case PRTS:  // Through the word ending the string
+                while (last + 1 < n && (words[last] & 0xff) && (words[last] & 0xff00)) {
+                    last++;
+                }
+                break;
+        }
+        if (last >= n) {
+            unchanged = "operands outside the program";
+            continue;
+        }
+        for (size_t word = operand; word <= last; word++) {
+            if (code[word] && writes) {
+                unchanged = "stores to code";
+            }
+            flags[word] |= code[word] ? OPT_PINNED : 0;
+        }
+    }
+    if (NULL == unchanged && mark_reachable(words, n, code, flags, pending)) {
+        unchanged = "execution running into data";
+    }
+    if (NULL != unchanged) {
+        if (NULL != log) {
+            fprintf(log, "\nOptimizer left \"%s\" as assembled: %s\n", programName, unchanged);
+        }
+        free(pending);
+        free(newAddr);
+        free(flags);
+        return 0;
+    }
+
+    // Thread branches through the branches they land on while the outcome is known
+    unsigned int numThreaded = 0;
+    unsigned int numHops = 0;       // Branches no longer dispatched on the way
+    for (size_t i = 0; i < n; i++) {
+        WORD_TYPE opcode = words[i] / 0x100;
+        if (!code[i] || (flags[i] & (OPT_PINNED | OPT_EXTERN)) || (B != opcode && BN != opcode && BZ != opcode)) { continue; }
+
+        size_t target = words[i] % 0x100;
+        unsigned int hops = 0;
+        for (size_t hop = 0; hop < n; hop++) {   // Bounded, as cycles of branches never end
+            if (!code[target] || (flags[target] & (OPT_PINNED | OPT_EXTERN))) { break; }
+
+            WORD_TYPE next = words[target] / 0x100;
+            size_t dest = target;
+            if (B == next || (opcode == next && (BN == next || BZ == next))) {
+                dest = words[target] % 0x100;   // Taken as well
+            } else if ((BZ == opcode && BN == next) || (BN == opcode && BZ == next)) {
+                dest = target + 1;              // Zero isn't negative, and negative isn't zero
+            }
+            if (dest == target || dest >= n || dest > 0xff || !code[dest]) { break; }
+
+            target = dest;
+            hops++;
+        }
+        if (hops) {
+            words[i] = (WORD_TYPE) (opcode * 0x100 + target);
+            numThreaded++;
+            numHops += hops;
+        }
+    }
+
+    // Reachability changes with the threaded branches
+    for (size_t i = 0; i < n; i++) {
+        flags[i] &= ~(OPT_REACHED | OPT_TARGETED);
+    }
+    mark_reachable(words, n, code, flags, pending);
+    for (size_t i = 0; i < n; i++) {
+        WORD_TYPE opcode = words[i] / 0x100;
+        if (code[i] && !(flags[i] & OPT_EXTERN) && (B == opcode || BN == opcode || BZ == opcode)) {
+            flags[words[i] % 0x100] |= OPT_TARGETED;
+        }
+    }
+
+    // Drop conditional branches never taken on what falls through to them, and branches to the next word
+    unsigned int numRedundant = 0;
+    int nonZero = 0;        // Accumulator facts along straight-line code
+    int nonNegative = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!code[i] || !(flags[i] & OPT_REACHED) || (flags[i] & (OPT_LABELED | OPT_TARGETED))) {
+            nonZero = nonNegative = 0;  // Arrived at from elsewhere
+        }
+        if (!code[i] || !(flags[i] & OPT_REACHED)) { continue; }
+
+        WORD_TYPE opcode = words[i] / 0x100;
+        if (!(flags[i] & (OPT_PINNED | OPT_LABELED)) && (B == opcode || BN == opcode || BZ == opcode)
+                && ((BZ == opcode && nonZero) || (BN == opcode && nonNegative)
+                || (!(flags[i] & OPT_EXTERN) && (size_t) (words[i] % 0x100) == i + 1))) {
+            flags[i] |= OPT_REMOVED;
+            numRedundant++;
+            continue;
+        }
+
+        switch (opcode) {
+            case BZ:    nonZero = 1;        break;  // Falling through
+            case BN:    nonNegative = 1;    break;
+            case LOAD:
+            case ADD:
+            case SUB:
+            case CAS:
+            case FADD:
+                nonZero = nonNegative = 0;
+                break;
+        }
+    }
+
+    // Drop unreachable code
+    unsigned int numDead = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (code[i] && !(flags[i] & (OPT_REACHED | OPT_PINNED | OPT_LABELED))) {
+            flags[i] |= OPT_REMOVED;
+            numDead++;
+        }
+    }
+
+    // Compact, a dropped word's address becoming that of the word after it
+    size_t numKept = 0;
+    for (size_t i = 0; i <= n; i++) {
+        newAddr[i] = numKept;
+        numKept += i < n && !(flags[i] & OPT_REMOVED);
+    }
+    size_t numRelocs = 0;
+    for (size_t r = 0; r < relocs->count; r++) {
+        size_t offset = relocs->offsets[r];
+        if (flags[offset] & OPT_REMOVED) { continue; }
+        words[offset] = (WORD_TYPE) (words[offset] / 0x100 * 0x100 + newAddr[words[offset] % 0x100]);
+        relocs->offsets[numRelocs++] = newAddr[offset];
+    }
+    relocs->count = numRelocs;
+    for (size_t slot = 0; slot < symbols->capacity; slot++) {
+        if (symbols->slots[slot].name.length && symbols->slots[slot].address <= n) {
+            symbols->slots[slot].address = newAddr[symbols->slots[slot].address];
+        }
+    }
+    for (Fixup *fixup = symbols->fixups; NULL != fixup; fixup = fixup->next) {
+        fixup->address = newAddr[fixup->address];
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!(flags[i] & OPT_REMOVED)) {
+            words[newAddr[i]] = words[i];
+            code[newAddr[i]] = code[i];
+        }
+    }
+    *numWords = numKept;
+
+    if (NULL != log) {
+        fprintf(log, "\nOptimized \"%s\": %zu of %zu words removed, %u unreachable and %u redundant branches\n",
+                programName, n - numKept, n, numDead, numRedundant);
+        fprintf(log, "%u branches threaded past %u others, saving %u dispatches each time through the changed code\n",
+                numThreaded, numHops, numHops + numRedundant);
+    }
+
+    free(pending);
+    free(newAddr);
+    free(flags);
+
+    return 0;
+}
+
+
+
+// Marks the code reachable from a program's first word and labels, following branches within the program
+// References left for the linker lead out of the program
+// Returns true if execution can run into a data word
+int mark_reachable( WORD_TYPE words[], size_t numWords, unsigned char code[], unsigned char flags[], size_t pending[] ) {
+    size_t numPending = 0;
+    for (size_t i = 0; i < numWords; i++) {
+        if (code[i] && (!i || (flags[i] & OPT_LABELED))) {
+            pending[numPending++] = i;
+            flags[i] |= OPT_REACHED;
+        }
+    }
+
+    while (numPending) {
+        size_t i = pending[--numPending];
+        WORD_TYPE opcode = words[i] / 0x100;
+        size_t next[2] = {i + 1, numWords};     // Successors, numWords for none
+        if (END == opcode) {
+            next[0] = numWords;
+        } else if (!(flags[i] & OPT_EXTERN) && (B == opcode || BN == opcode || BZ == opcode)) {
+            next[B == opcode ? 0 : 1] = words[i] % 0x100;
+        } else if (B == opcode) {
+            next[0] = numWords;
+        }
+
+        for (size_t s = 0; s < 2; s++) {
+            if (next[s] >= numWords || (flags[next[s]] & OPT_REACHED)) { continue; }    // Running off the end leaves the program
+            if (!code[next[s]]) { return 1; }
+            flags[next[s]] |= OPT_REACHED;
+            pending[numPending++] = next[s];
+        }
+    }
+
+    return 0;
+}
+
+
+
+// ______________________________
+//          SYMBOL TABLE
+// ______________________________
+
+
+
+// Allocates zeroed storage from an arena, adding a block when the current one is full
+void *arena_alloc( Arena *arena, size_t size ) {
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;  // Keep allocations aligned
+
+    if (NULL == arena->head || arena->head->used + size > arena->head->size) {
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        ArenaBlock *block = malloc(sizeof(ArenaBlock) + blockSize);
+        if (NULL == block) { return NULL; }
+        block->next = arena->head;
+        block->used = 0;
+        block->size = blockSize;
+        arena->head = block;
+    }
+
+    void *allocation = &arena->head->data[arena->head->used];
+    arena->head->used += size;
+    memset(allocation, 0, size);
+
+    return allocation;
+}
+
+
+
+// Frees every block of an arena
+void free_arena( Arena *arena ) {
+    while (NULL != arena->head) {
+        ArenaBlock *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+
+
+// Initializes an empty symbol table allocated from an arena
+int init_symbols( SymbolTable *symbols, Arena *arena ) {
+    symbols->arena = arena;
+    symbols->capacity = SYMBOLS_MIN_CAPACITY;
+    symbols->count = 0;
+    symbols->fixups = NULL;
+    symbols->lastFixup = NULL;
+    symbols->pendingLabel = NULL;
+    symbols->pendingLine = 0;
+    symbols->slots = arena_alloc(arena, symbols->capacity * sizeof(Label));
+
+    return NULL == symbols->slots ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Hashes a label name without regard to case (FNV-1a)
+size_t hash_label( Token name ) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < name.length; i++) {
+        hash ^= (unsigned char) toupper(name.start[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+
+// Returns true if two label names match without regard to case
+int labels_equal( Token a, Token b ) {
+    if (a.length != b.length) { return 0; }
+    for (size_t i = 0; i < a.length; i++) {
+        if (toupper(a.start[i]) != toupper(b.start[i])) { return 0; }
+    }
+    return 1;
+}
+
+
+
+// Returns the table slot holding a label name, or the empty slot it would occupy
+Label *find_slot( Label slots[], size_t capacity, Token name ) {
+    size_t slot = hash_label(name) & (capacity - 1);
+    // Probe linearly until match or empty slot
+    while (0 != slots[slot].name.length && !labels_equal(slots[slot].name, name)) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return &slots[slot];
+}
+
+
+
+// Defines a label at a program address, keeping the first definition of repeated labels
+// Returns the label entry or NULL if out of memory
+Label *define_label( SymbolTable *symbols, Token name, size_t address ) {
+    // Double capacity before the table passes 3/4 full
+    if (4 * (symbols->count + 1) > 3 * symbols->capacity) {
+        size_t capacity = 2 * symbols->capacity;
+        Label *slots = arena_alloc(symbols->arena, capacity * sizeof(Label));
+        if (NULL == slots) { return NULL; }
+
+        for (size_t i = 0; i < symbols->capacity; i++) {    // Rehash existing labels
+            if (0 != symbols->slots[i].name.length) {
+                *find_slot(slots, capacity, symbols->slots[i].name) = symbols->slots[i];
+            }
+        }
+        symbols->slots = slots;
+        symbols->capacity = capacity;
+    }
+
+    Label *label = find_slot(symbols->slots, symbols->capacity, name);
+    if (0 == label->name.length) {  // New label
+        label->name = name;
+        label->address = address;
+        symbols->count++;
+    }
+
+    return label;
+}
+
+
+
+// Returns the program address of a known label reference
+size_t resolve_label( Token reference, SymbolTable *symbols ) {
+    Label *label = find_slot(symbols->slots, symbols->capacity, reference);
+    return 0 != label->name.length ? label->address : NO_LABEL;
+}
+
+
+
+// Records a reference to a not yet defined label
+int add_fixup( SymbolTable *symbols, Token name, size_t address, WORD_TYPE instrWord, size_t lineNum ) {
+    Fixup *fixup = arena_alloc(symbols->arena, sizeof(Fixup));
+    if (NULL == fixup) { return PROG_ACC_ERR; }
+
+    fixup->name = name;
+    fixup->address = address;
+    fixup->instrWord = instrWord;
+    fixup->lineNum = lineNum;
+    fixup->next = NULL;
+
+    // Append to keep diagnostics in line order
+    if (NULL == symbols->lastFixup) {
+        symbols->fixups = fixup;
+    } else {
+        symbols->lastFixup->next = fixup;
+    }
+    symbols->lastFixup = fixup;
+
+    return 0;
+}
+
+
+
+// Patches forward references to labels the program defines and records their relocations
+// Returns the number of references left for the linker
+unsigned int patch_fixups( SymbolTable *symbols, WORD_TYPE words[], RelocTable *relocs ) {
+    unsigned int numExterns = 0;
+
+    for (Fixup *fixup = symbols->fixups; NULL != fixup; fixup = fixup->next) {
+        size_t reference = resolve_label(fixup->name, symbols);
+        if (NO_LABEL == reference) {
+            numExterns++;
+            continue;
+        }
+
+        words[fixup->address] = (WORD_TYPE) (fixup->instrWord + reference);
+        if (END != fixup->instrWord / 0x100) {
+            relocs->offsets[relocs->count++] = fixup->address;
+        }
+    }
+
+    return numExterns;
+}
+
+
+
+// ______________________________
+//            LINKING
+// ______________________________
+
+
+
+// Writes an assembled program as a relocatable object file
+// Labels are exported and references to labels the program doesn't define are left for the linker
+int write_object( char objectName[], WORD_TYPE words[], size_t numWords, RelocTable *relocs, SymbolTable *symbols, int optimized ) {
+    if (numWords > 0xffff) { return BAD_PROGRAM; }  // Offsets are 16 bit
+
+    ObjectHeader header;
+    memcpy(header.magic, OBJECT_MAGIC, sizeof(header.magic));
+    header.version = OBJECT_VERSION;
+    header.numWords = numWords;
+    header.numRelocs = relocs->count;
+    header.numSymbols = symbols->count;
+    header.numExterns = 0;
+    header.flags = optimized ? OBJECT_OPTIMIZED : 0;
+    for (Fixup *fixup = symbols->fixups; NULL != fixup; fixup = fixup->next) {
+        if (NO_LABEL == resolve_label(fixup->name, symbols)) {
+            header.numExterns++;
+        }
+    }
+
+    FILE *object = fopen(objectName, "wb");     // Create/open output file
+    if (NULL == object) { return PROG_ACC_ERR; }
+
+    fwrite(&header, sizeof(header), 1, object);
+    fwrite(words, sizeof(WORD_TYPE), numWords, object);
+    fwrite(relocs->offsets, sizeof(unsigned short), relocs->count, object);
+
+    // Exported labels
+    for (size_t slot = 0; slot < symbols->capacity; slot++) {
+        if (0 != symbols->slots[slot].name.length) {
+            write_symbol(object, symbols->slots[slot].address, 0, symbols->slots[slot].name);
+        }
+    }
+
+    // External references
+    for (Fixup *fixup = symbols->fixups; NULL != fixup; fixup = fixup->next) {
+        if (NO_LABEL == resolve_label(fixup->name, symbols)) {
+            write_symbol(object, fixup->address, fixup->lineNum, fixup->name);
+        }
+    }
+
+    return fclose(object) ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Writes an object label record followed by its name padded to an even length
+void write_symbol( FILE *object, size_t address, size_t lineNum, Token name ) {
+    ObjectSymbol symbol = {address, lineNum, name.length};
+    fwrite(&symbol, sizeof(symbol), 1, object);
+    fwrite(name.start, 1, name.length, object);
+    if (name.length % 2) {
+        fputc('\0', object);
+    }
+}
+
+
+
+// Returns the object label record following the given one
+char *next_symbol( char *record ) {
+    return record + sizeof(ObjectSymbol) + (((ObjectSymbol *) record)->nameLength + 1) / 2 * 2;
+}
+
+
+
+// Reads and validates a whole object file
+int read_object( char objectName[], Module *module ) {
+    size_t objectLen = 0;
+    module->object = read_file(objectName, &objectLen);  // Read in one block
+    if (NULL == module->object) { return PROG_ACC_ERR; }
+
+    char *end = module->object + objectLen;
+    module->header = (ObjectHeader *) module->object;
+    if (objectLen < sizeof(ObjectHeader)
+            || memcmp(module->header->magic, OBJECT_MAGIC, sizeof(module->header->magic))
+            || OBJECT_VERSION != module->header->version) {
+        free(module->object);
+        return BAD_PROGRAM;
+    }
+
+    // Locate sections
+    module->words = (WORD_TYPE *) (module->object + sizeof(ObjectHeader));
+    module->relocs = (unsigned short *) (module->words + module->header->numWords);
+    module->symbols = (char *) (module->relocs + module->header->numRelocs);
+
+    // Validate relocations and records
+    int valid = module->symbols <= end;
+    for (size_t i = 0; valid && i < module->header->numRelocs; i++) {
+        valid = module->relocs[i] < module->header->numWords;
+    }
+    char *record = module->symbols;
+    for (size_t i = 0; valid && i < module->header->numSymbols + module->header->numExterns; i++) {
+        if (i == module->header->numSymbols) {
+            module->externs = record;
+        }
+        valid = record + sizeof(ObjectSymbol) <= end && next_symbol(record) <= end
+                && ((ObjectSymbol *) record)->address < module->header->numWords;
+        if (valid) {
+            record = next_symbol(record);
+        }
+    }
+    if (!module->header->numExterns) {
+        module->externs = record;
+    }
+
+    if (!valid) {
+        free(module->object);
+        return BAD_PROGRAM;
+    }
+
+    return 0;
+}
+
+
+
+// Links object modules consecutively from the given address and loads them to a memory image
+// Labels are shared between modules, keeping the first definition of repeated labels
+// Diagnostics are printed to log, if given
+// Returns the number of words loaded
+int link_program( char *objectNames[], size_t numModules, size_t address, Memory *mem, FILE *log ) {
+    Module modules[MAX_MODULES];
+    WORD_TYPE image[NUM_MEM_WORDS];     // Linked program
+    size_t numWords = 0;
+    size_t numRead = 0;
+    unsigned int numErrors = 0;
+    int status = 0;
+
+    Arena arena = {NULL};   // Symbol table storage
+    SymbolTable symbols;
+    if (numModules > MAX_MODULES || init_symbols(&symbols, &arena)) { return PROG_ACC_ERR; }
+
+    // Place modules and define their labels
+    while (!status && numRead < numModules) {
+        Module *module = &modules[numRead];
+        status = read_object(objectNames[numRead], module);
+        if (status) { break; }
+        numRead++;
+
+        module->base = address + numWords;
+        numWords += module->header->numWords;
+        if (address + numWords > NUM_MEM_WORDS) {   // Program overruns memory
+            status = INV_ADDR;
+            break;
+        }
+
+        char *record = module->symbols;
+        for (size_t i = 0; i < module->header->numSymbols; i++, record = next_symbol(record)) {
+            Token name = {record + sizeof(ObjectSymbol), ((ObjectSymbol *) record)->nameLength};
+            if (NULL == define_label(&symbols, name, module->base + ((ObjectSymbol *) record)->address)) {
+                status = PROG_ACC_ERR;
+            }
+        }
+    }
+
+    // Relocate modules and resolve external references
+    for (size_t m = 0; !status && m < numRead; m++) {
+        Module *module = &modules[m];
+        WORD_TYPE *words = &image[module->base - address];
+        memcpy(words, module->words, module->header->numWords * sizeof(WORD_TYPE));
+
+        for (size_t i = 0; i < module->header->numRelocs; i++) {
+            words[module->relocs[i]] += (WORD_TYPE) module->base;
+        }
+
+        char *record = module->externs;
+        for (size_t i = 0; i < module->header->numExterns; i++, record = next_symbol(record)) {
+            ObjectSymbol *symbol = (ObjectSymbol *) record;
+            Token name = {record + sizeof(ObjectSymbol), symbol->nameLength};
+            size_t reference = resolve_label(name, &symbols);
+            if (NO_LABEL == reference) {
+                if (NULL != log) {
+                    fprintf(log, "Line %u - undefined label \"%.*s\" in \"%s\"\n", symbol->lineNum, (int) name.length, name.start, objectNames[m]);
+                }
+                numErrors++;
+            } else {
+                words[symbol->address] += (WORD_TYPE) reference;
+            }
+        }
+    }
+
+    // Load linked program
+    if (!status && numErrors) {
+        if (NULL != log) {
+            fprintf(log, "\nFailed to link program: %u errors contained\n\n", numErrors);
+        }
+        status = BAD_PROGRAM;
+    }
+    if (!status) {
+        place_words(mem, image, numWords, address);
+    }
+    for (size_t m = 0; !status && NULL != log && m < numRead; m++) {
+        fprintf(log, "\nLoaded \"%s\" to TIMS memory word %zu\n\n", objectNames[m], modules[m].base);
+    }
+
+    free_arena(&arena);     // Labels reference the objects, so free them last
+    for (size_t m = 0; m < numRead; m++) {
+        free(modules[m].object);
+    }
+
+    return status ? status : (int) numWords;
+}
+
+
+
+// ______________________________
+//          IMAGE CACHE
+// ______________________________
+
+
+
+// Hashes program sources in link order together with the assembler version and optimization (FNV-1a)
+// Returns 0 if a source can't be read
+unsigned long long hash_program( char *programNames[], size_t numPrograms, int optimize ) {
+    unsigned long long hash = 14695981039346656037ull;
+    const char *version = ASSEMBLER_VERSION;
+    for (size_t i = 0; '\0' != version[i]; i++) {
+        hash = (hash ^ (unsigned char) version[i]) * 1099511628211ull;
+    }
+    if (optimize) {     // Optimized images differ
+        hash = (hash ^ 0xfe) * 1099511628211ull;
+    }
+
+    for (size_t p = 0; p < numPrograms; p++) {
+        size_t sourceLen = 0;
+        char *source = read_file(programNames[p], &sourceLen);
+        if (NULL == source) { return 0; }
+
+        for (size_t i = 0; i < sourceLen; i++) {
+            hash = (hash ^ (unsigned char) source[i]) * 1099511628211ull;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ull;    // Separate sources
+
+        free(source);
+    }
+
+    return hash ? hash : 1;     // Reserve 0 for failure
+}
+
+
+
+// Loads the cached image of a program source relocated to the given address
+// Returns NO_IMAGE if no valid image is cached
+int load_image( unsigned long long hash, size_t address, Memory *mem, size_t *entry ) {
+    char imageName[IMAGE_NAME_SIZE];
+    sprintf(imageName, IMAGE_NAME_FORMAT, hash, (unsigned int) address);
+
+    FILE *imageFile = fopen(imageName, "rb");
+    if (NULL == imageFile) { return NO_IMAGE; }
+
+    // Read header and words in one block
+    Image image;
+    size_t imageSize = fread(&image, 1, sizeof(Image), imageFile);
+    fclose(imageFile);
+
+    // Validate image
+    if (imageSize < sizeof(ImageHeader)
+            || memcmp(image.header.magic, IMAGE_MAGIC, sizeof(image.header.magic))
+            || IMAGE_VERSION != image.header.version
+            || address != image.header.address
+            || address + image.header.numWords > NUM_MEM_WORDS
+            || imageSize < sizeof(ImageHeader) + image.header.numWords * sizeof(WORD_TYPE)) {
+        return NO_IMAGE;
+    }
+
+    place_words(mem, image.words, image.header.numWords, address);
+
+    *entry = image.header.entry;
+    printf("\nLoaded cached image \"%s\" to TIMS memory word %zu\n\n", imageName, address);
+
+    return 0;
+}
+
+
+
+// Caches the relocated program words just loaded at the given address
+int cache_image( unsigned long long hash, size_t address, size_t numWords, Memory *mem ) {
+    Image image;
+    memcpy(image.header.magic, IMAGE_MAGIC, sizeof(image.header.magic));
+    image.header.version = IMAGE_VERSION;
+    image.header.numWords = numWords;
+    image.header.address = address;
+    image.header.entry = address;
+    memcpy(image.words, &mem->words[address], numWords * sizeof(WORD_TYPE));
+
+    char imageName[IMAGE_NAME_SIZE];
+    sprintf(imageName, IMAGE_NAME_FORMAT, hash, (unsigned int) address);
+
+    FILE *imageFile = fopen(imageName, "wb");
+    if (NULL == imageFile) { return NO_IMAGE; }
+
+    size_t imageSize = sizeof(ImageHeader) + numWords * sizeof(WORD_TYPE);
+    if (imageSize != fwrite(&image, 1, imageSize, imageFile)) {
+        fclose(imageFile);
+        remove(imageName);  // Never leave a truncated image behind
+        return NO_IMAGE;
+    }
+
+    return fclose(imageFile) ? NO_IMAGE : 0;
+}
+
+
+
+// ______________________________
+//           SNAPSHOTS
+// ______________________________
+
+
+
+// Captures a machine's registers, base memory and every extended page holding data in one block
+// Empty pages read as zero either way, so snapshots hold only the pages that differ from fresh memory
+// Returns the block, to be freed by the caller, or NULL on failure
+char *build_snapshot( Machine *vm, size_t *size ) {
+    Memory *mem = &vm->mem;
+    static const WORD_TYPE emptyPage[EXT_PAGE_WORDS];
+
+    size_t numPages = 0;
+    for (size_t page = 0; NULL != mem->pages && page < EXT_NUM_PAGES; page++) {
+        numPages += NULL != mem->pages[page] && memcmp(mem->pages[page], emptyPage, sizeof(emptyPage));
+    }
+
+    *size = sizeof(SnapshotHeader) + sizeof(mem->words) + numPages * sizeof(PageRecord);
+    char *snapshot = calloc(1, *size);
+    if (NULL == snapshot) { return NULL; }
+
+    SnapshotHeader *header = (SnapshotHeader *) snapshot;
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->instrCount = vm->instrCount;
+    header->instrPtr = vm->instrPtr;
+    header->numPages = numPages;
+    header->ioIntBuff = vm->ioIntBuff;
+    header->instrReg = vm->instrReg;
+    header->accumulator = vm->accumulator;
+    header->extended = NULL != mem->pages;
+    memcpy(&snapshot[sizeof(SnapshotHeader)], mem->words, sizeof(mem->words));
+
+    PageRecord *record = (PageRecord *) &snapshot[sizeof(SnapshotHeader) + sizeof(mem->words)];
+    for (size_t page = 0; NULL != mem->pages && page < EXT_NUM_PAGES; page++) {
+        if (NULL == mem->pages[page] || !memcmp(mem->pages[page], emptyPage, sizeof(emptyPage))) { continue; }
+        record->page = page;
+        memcpy(record->words, mem->pages[page], sizeof(record->words));
+        record++;
+    }
+
+    return snapshot;
+}
+
+
+
+// Resumes a machine from a captured block, replacing its registers and memory
+// Execution picks up at the snapshot's instruction pointer, counting on from its instruction count
+int restore_snapshot( Machine *vm, const char snapshot[], size_t size ) {
+    Memory *mem = &vm->mem;
+    const SnapshotHeader *header = (const SnapshotHeader *) snapshot;
+
+    // Validate snapshot
+    if (size < sizeof(SnapshotHeader) + sizeof(mem->words)
+            || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))
+            || SNAPSHOT_VERSION != header->version
+            || header->numPages > EXT_NUM_PAGES
+            || (header->numPages && !header->extended)
+            || size != sizeof(SnapshotHeader) + sizeof(mem->words) + header->numPages * sizeof(PageRecord)) {
+        return BAD_SNAPSHOT;
+    }
+    const PageRecord *records = (const PageRecord *) &snapshot[sizeof(SnapshotHeader) + sizeof(mem->words)];
+    for (size_t r = 0; r < header->numPages; r++) {
+        if (records[r].page >= EXT_NUM_PAGES) { return BAD_SNAPSHOT; }
+    }
+
+    // Replace memory, pages left out being empty
+    free_pages(mem);
+    if (header->extended && init_pages(mem)) { return MEM_ACC_ERR; }
+    memcpy(mem->words, &snapshot[sizeof(SnapshotHeader)], sizeof(mem->words));
+    for (size_t r = 0; r < header->numPages; r++) {
+        WORD_TYPE *words = page_word(mem, (size_t) records[r].page * EXT_PAGE_WORDS, 1);
+        if (NULL == words) { return MEM_ACC_ERR; }
+        memcpy(words, records[r].words, sizeof(records[r].words));
+    }
+    memset(mem->dirtyRows, 0xff, sizeof(mem->dirtyRows));   // Every row differs from the formatted memory
+
+    vm->instrCount = header->instrCount;
+    vm->instrPtr = header->instrPtr;
+    vm->ioIntBuff = header->ioIntBuff;
+    vm->instrReg = header->instrReg;
+    vm->accumulator = header->accumulator;
+
+    return 0;
+}
+
+
+
+// Writes a snapshot of a machine to a file in one write
+int save_snapshot( Machine *vm, char snapshotName[] ) {
+    size_t snapshotSize = 0;
+    char *snapshot = build_snapshot(vm, &snapshotSize);
+    if (NULL == snapshot) { return PROG_ACC_ERR; }
+
+    FILE *snapshotFile = fopen(snapshotName, "wb");
+    if (NULL == snapshotFile) {
+        free(snapshot);
+        return PROG_ACC_ERR;
+    }
+
+    int status = snapshotSize == fwrite(snapshot, 1, snapshotSize, snapshotFile) ? 0 : PROG_ACC_ERR;
+    if (fclose(snapshotFile)) {
+        status = PROG_ACC_ERR;
+    }
+    if (status) {
+        remove(snapshotName);   // Never leave a truncated snapshot behind
+    }
+    free(snapshot);
+
+    return status;
+}
+
+
+
+// Resumes a machine from a snapshot file, mapped rather than read where supported
+int load_snapshot( Machine *vm, char snapshotName[] ) {
+#ifdef __unix__
+    int snapshotFd = open(snapshotName, O_RDONLY);
+    if (snapshotFd < 0) { return PROG_ACC_ERR; }
+
+    struct stat info;
+    void *snapshot = MAP_FAILED;
+    if (!fstat(snapshotFd, &info) && info.st_size > 0) {
+        snapshot = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, snapshotFd, 0);
+    }
+    close(snapshotFd);
+    if (MAP_FAILED == snapshot) { return BAD_SNAPSHOT; }
+
+    int status = restore_snapshot(vm, snapshot, info.st_size);
+    munmap(snapshot, info.st_size);
+#else
+    size_t snapshotSize = 0;
+    char *snapshot = read_file(snapshotName, &snapshotSize);
+    if (NULL == snapshot) { return PROG_ACC_ERR; }
+
+    int status = restore_snapshot(vm, snapshot, snapshotSize);
+    free(snapshot);
+#endif
+
+    return status;
+}
+
+
+
+// ______________________________
+//             BATCH
+// ______________________________
+
+
+
+// Initializes a machine with cleared registers and memory
+// Pending output is flushed whenever the machine waits for input
+void init_machine( Machine *vm, Channel *input, Channel *output ) {
+    memset(vm, 0, sizeof(Machine));
+    vm->input = input;
+    vm->output = output;
+    input->tie = output;
+}
+
+
+
+// Assembles every source given, and every source in each directory given, on a pool of threads
+// Sources whose object is newer are skipped unless the cache is off
+// Diagnostics are printed per source in the order given, directories in name order, whatever order they finish in
+int run_build( char *paths[], size_t numPaths, size_t numThreads, int optimize, int useCache, char *mnemonics[], WORD_TYPE opcodes[] ) {
+    Build build = {NULL, 0, 0, mnemonics, opcodes, optimize};
+    size_t capacity = 0;
+    int status = 0;
+    for (size_t p = 0; !status && p < numPaths; p++) {
+        status = add_sources(&build, &capacity, paths[p]);
+        if (status) {
+            printf("Can't build \"%s\"\n", paths[p]);
+        }
+    }
+    if (status || !build.numJobs) {
+        free(build.jobs);
+        return status ? status : PROG_ACC_ERR;
+    }
+
+#ifdef __unix__
+    // Skip sources older than their objects, unless the objects were assembled with other optimization
+    struct stat sourceInfo, objectInfo;
+    for (size_t j = 0; useCache && j < build.numJobs; j++) {
+        AsmJob *job = &build.jobs[j];
+        char object[PATH_SIZE];
+        object_name(object, job->source);
+        if (stat(job->source, &sourceInfo) || stat(object, &objectInfo) || objectInfo.st_mtime < sourceInfo.st_mtime) { continue; }
+
+        ObjectHeader header;
+        FILE *objectFile = fopen(object, "rb");
+        if (NULL == objectFile) { continue; }
+        job->unchanged = 1 == fread(&header, sizeof(header), 1, objectFile)
+                && !memcmp(header.magic, OBJECT_MAGIC, sizeof(header.magic)) && OBJECT_VERSION == header.version
+                && (optimize ? OBJECT_OPTIMIZED : 0) == (header.flags & OBJECT_OPTIMIZED);
+        fclose(objectFile);
+    }
+#endif
+
+    // Run workers
+    if (!numThreads) {
+        numThreads = 1;
+    }
+    if (numThreads > build.numJobs) {
+        numThreads = build.numJobs;
+    }
+    pthread_t *threads = calloc(numThreads, sizeof(pthread_t));
+    size_t numStarted = 0;
+    for (; NULL != threads && numStarted < numThreads; numStarted++) {
+        if (pthread_create(&threads[numStarted], NULL, build_worker, &build)) { break; }
+    }
+    if (!numStarted) {  // Run on this thread if none could start
+        build_worker(&build);
+    }
+    for (size_t t = 0; t < numStarted; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // Replay diagnostics in source order
+    unsigned int numFailed = 0;
+    unsigned int numUnchanged = 0;
+    char text[FORMAT_BUFFER_SIZE];
+    for (size_t j = 0; j < build.numJobs; j++) {
+        AsmJob *job = &build.jobs[j];
+        if (NULL != job->log) {
+            rewind(job->log);
+            for (size_t length; 0 < (length = fread(text, 1, sizeof(text), job->log)); ) {
+                fwrite(text, 1, length, stdout);
+            }
+            fclose(job->log);
+        }
+        if (job->status) {
+            printf("\"%s\" failed (%d)\n", job->source, job->status);
+        }
+        numFailed += 0 != job->status;
+        numUnchanged += job->unchanged;
+    }
+    printf("\nAssembled %zu of %zu sources on %zu threads, %u unchanged, %u failed\n\n",
+            build.numJobs - numUnchanged - numFailed, build.numJobs, numStarted ? numStarted : 1, numUnchanged, numFailed);
+
+    free(threads);
+    free(build.jobs);
+
+    return numFailed ? BAD_PROGRAM : 0;
+}
+
+
+
+// Adds a source to a build, or each source of a directory in name order, leaving out assembled objects
+int add_sources( Build *build, size_t *capacity, char path[] ) {
+    size_t numNames = 1;
+    char **names = &path;
+#ifdef __unix__
+    struct dirent **entries = NULL;
+    struct stat info;
+    int isDirectory = !stat(path, &info) && S_ISDIR(info.st_mode);
+    if (isDirectory) {
+        int numEntries = scandir(path, &entries, NULL, alphasort);
+        if (numEntries < 0) { return PROG_ACC_ERR; }
+        numNames = numEntries;
+    }
+#endif
+
+    int status = 0;
+    for (size_t n = 0; !status && n < numNames; n++) {
+        char source[PATH_SIZE];
+#ifdef __unix__
+        if (isDirectory) {
+            const char *name = entries[n]->d_name;
+            size_t nameLen = strlen(name);
+            size_t extensionLen = strlen(SOURCE_EXTENSION);
+            if (nameLen <= extensionLen || strcmp(&name[nameLen - extensionLen], SOURCE_EXTENSION)
+                    || (nameLen >= extensionLen + 3 && !strncmp(&name[nameLen - extensionLen - 3], "Asm", 3))) {
+                continue;   // Not a source, or an assembled object
+            }
+            int sourceLen = snprintf(source, sizeof(source), "%s/%s", path, name);
+            if (sourceLen < 0 || (size_t) sourceLen + 3 >= sizeof(source)) {   // Leave room to name the object
+                status = PROG_ACC_ERR;
+                break;
+            }
+        } else
+#endif
+        {
+            if (strlen(names[n]) + 3 >= PATH_SIZE) {
+                status = PROG_ACC_ERR;
+                break;
+            }
+            strcpy(source, names[n]);
+        }
+
+        // Grow the job list
+        if (build->numJobs == *capacity) {
+            size_t newCapacity = *capacity ? 2 * *capacity : 16;
+            AsmJob *jobs = realloc(build->jobs, newCapacity * sizeof(AsmJob));
+            if (NULL == jobs) {
+                status = PROG_ACC_ERR;
+                break;
+            }
+            build->jobs = jobs;
+            *capacity = newCapacity;
+        }
+        AsmJob *job = &build->jobs[build->numJobs++];
+        memset(job, 0, sizeof(AsmJob));
+        strcpy(job->source, source);
+    }
+
+#ifdef __unix__
+    for (size_t n = 0; isDirectory && n < numNames; n++) {
+        free(entries[n]);
+    }
+    free(entries);
+#endif
+
+    return status;
+}
+
+
+
+// Assembles the next unassembled source of a build until none remain
+// Each source's diagnostics go to its own log, as sources finish in any order
+void *build_worker( void *arg ) {
+    Build *build = arg;
+
+    for (size_t j; (j = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED)) < build->numJobs; ) {
+        AsmJob *job = &build->jobs[j];
+        if (job->unchanged) { continue; }
+
+        job->log = tmpfile();
+        strcpy(job->object, job->source);
+        job->status = assemble_program(job->object, build->mnemonics, build->opcodes, build->optimize, NULL == job->log ? stdout : job->log);
+    }
+
+    return NULL;
+}
+
+
+
+// Reads a manifest and assembles each distinct program of its jobs
+// Each manifest line holds a program, load address, input file and output file
+// Job file names point into the returned manifest text, which the caller frees with the jobs
+int load_manifest( char manifestName[], Batch *batch, char **manifest, char *mnemonics[], WORD_TYPE opcodes[] ) {
+    size_t manifestLen = 0;
+    *manifest = read_file(manifestName, &manifestLen);
+    if (NULL == *manifest) { return PROG_ACC_ERR; }
+
+    // Count lines for the job list
+    size_t maxJobs = 1;
+    for (size_t i = 0; i < manifestLen; i++) {
+        maxJobs += '\n' == (*manifest)[i];
+    }
+
+    batch->jobs = calloc(maxJobs, sizeof(Job));
+    batch->numJobs = 0;
+    if (NULL == batch->jobs) {
+        free(*manifest);
+        return PROG_ACC_ERR;
+    }
+
+    // Parse jobs, terminating fields in place
+    size_t lineNum = 1;
+    unsigned int numErrors = 0;
+    for (char *line = *manifest; line < *manifest + manifestLen; lineNum++) {
+        char *lineEnd = memchr(line, '\n', *manifest + manifestLen - line);
+        if (NULL == lineEnd) {
+            lineEnd = *manifest + manifestLen;
+        }
+
+        Token fields[4];
+        size_t numFields = 0;
+        for (Token token = next_token(line, lineEnd); token.length && numFields < 4; token = next_token(token.start + token.length, lineEnd)) {
+            fields[numFields++] = token;
+        }
+        line = lineEnd + 1;
+
+        if (!numFields) { continue; }   // Skip blank lines
+        if (4 != numFields || fields[0].length + 4 > sizeof(batch->jobs[0].program)) {  // Room for "Asm" in object name
+            printf("Line %zu - invalid job\n", lineNum);
+            numErrors++;
+            continue;
+        }
+
+        for (size_t f = 0; f < 4; f++) {
+            ((char *) fields[f].start)[fields[f].length] = '\0';
+        }
+
+        Job *job = &batch->jobs[batch->numJobs++];
+        memcpy(job->program, fields[0].start, fields[0].length + 1);
+        job->address = strtol(fields[1].start, NULL, 10);
+        job->input = (char *) fields[2].start;
+        job->output = (char *) fields[3].start;
+    }
+
+    // Assemble each distinct program once before running
+    for (size_t j = 0; !numErrors && j < batch->numJobs; j++) {
+        Job *job = &batch->jobs[j];
+        strcpy(job->object, job->program);
+
+        size_t prev = 0;
+        while (prev < j && strcmp(batch->jobs[prev].program, job->program)) {
+            prev++;
+        }
+        if (prev < j) {
+            strcpy(job->object, batch->jobs[prev].object);
+        } else if (assemble_program(job->object, mnemonics, opcodes, 0, stdout)) {
+            numErrors++;
+        }
+    }
+
+    if (numErrors) {
+        printf("\nFailed to run batch \"%s\": %u errors contained\n\n", manifestName, numErrors);
+        free(batch->jobs);
+        free(*manifest);
+        return BAD_PROGRAM;
+    }
+
+    return 0;
+}
+
+
+
+// Runs every job of a batch manifest across a pool of worker threads
+int run_batch( char manifestName[], size_t numThreads, char *mnemonics[], WORD_TYPE opcodes[] ) {
+    Batch batch = {NULL, 0, NULL, 0};
+    char *manifest = NULL;
+    int status = load_manifest(manifestName, &batch, &manifest, mnemonics, opcodes);
+    if (status) { return status; }
+
+    // Deal jobs round-robin to worker queues, then let idle workers steal
+    if (!numThreads) {
+        numThreads = 1;
+    }
+    batch.numQueues = numThreads;
+    batch.queues = calloc(numThreads, sizeof(JobQueue));
+    Worker *workers = calloc(numThreads, sizeof(Worker));
+    size_t *slots = calloc(batch.numJobs + 1, sizeof(size_t));
+    if (NULL == batch.queues || NULL == workers || NULL == slots) {
+        free(slots);
+        free(workers);
+        free(batch.queues);
+        free(batch.jobs);
+        free(manifest);
+        return PROG_ACC_ERR;
+    }
+
+    for (size_t q = 0, first = 0; q < numThreads; q++) {
+        JobQueue *queue = &batch.queues[q];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->jobs = &slots[first];
+        for (size_t j = q; j < batch.numJobs; j += numThreads) {
+            queue->jobs[queue->bottom++] = j;
+        }
+        first += queue->bottom;
+    }
+
+    // Run workers
+    size_t numStarted = 0;
+    for (; numStarted < numThreads; numStarted++) {
+        workers[numStarted].batch = &batch;
+        workers[numStarted].queue = numStarted;
+        if (pthread_create(&workers[numStarted].thread, NULL, batch_worker, &workers[numStarted])) { break; }
+    }
+    if (!numStarted) {  // Run on this thread if none could start
+        workers[0].batch = &batch;
+        batch_worker(&workers[0]);
+    }
+    for (size_t w = 0; w < numStarted; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+
+    // Report failed jobs in manifest order
+    unsigned int numFailed = 0;
+    for (size_t j = 0; j < batch.numJobs; j++) {
+        if (batch.jobs[j].status) {
+            printf("Job %zu - \"%s\" failed (%d)\n", j + 1, batch.jobs[j].program, batch.jobs[j].status);
+            numFailed++;
+        }
+    }
+    printf("\nRan %zu jobs on %zu threads, %u failed\n\n", batch.numJobs, numStarted ? numStarted : 1, numFailed);
+
+    for (size_t q = 0; q < numThreads; q++) {
+        pthread_mutex_destroy(&batch.queues[q].lock);
+    }
+    free(slots);
+    free(workers);
+    free(batch.queues);
+    free(batch.jobs);
+    free(manifest);
+
+    return numFailed ? BAD_PROGRAM : 0;
+}
+
+
+
+// Runs jobs from a worker's own queue, then steals from the others until all are empty
+void *batch_worker( void *arg ) {
+    Worker *worker = arg;
+    Batch *batch = worker->batch;
+    size_t jobIndex = 0;
+
+    for (;;) {
+        // Take newest job from own queue, else oldest job of another
+        int found = take_job(&batch->queues[worker->queue], 0, &jobIndex);
+        for (size_t q = 1; !found && q < batch->numQueues; q++) {
+            found = take_job(&batch->queues[(worker->queue + q) % batch->numQueues], 1, &jobIndex);
+        }
+        if (!found) { break; }  // All queues drained, as jobs never add jobs
+
+        Job *job = &batch->jobs[jobIndex];
+        job->status = run_job(job);
+    }
+
+    return NULL;
+}
+
+
+
+// Takes a job from the bottom of a queue, or from the top if stealing
+// Returns true if a job was taken
+int take_job( JobQueue *queue, int steal, size_t *jobIndex ) {
+    int found = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->top < queue->bottom) {
+        *jobIndex = steal ? queue->jobs[queue->top++] : queue->jobs[--queue->bottom];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+
+
+// Links and executes one job on a private machine
+int run_job( Job *job ) {
+    FILE *inputFile = fopen(job->input, "rb");
+    if (NULL == inputFile) { return PROG_ACC_ERR; }
+    FILE *outputFile = fopen(job->output, "wb");
+    if (NULL == outputFile) {
+        fclose(inputFile);
+        return PROG_ACC_ERR;
+    }
+
+    Channel input, output;
+    int status = open_channel(&input, inputFile) | open_channel(&output, outputFile);
+
+    Machine vm;
+    init_machine(&vm, &input, &output);
+    vm.instrPtr = job->address;
+
+    char *object = job->object;
+    if (!status) {
+        status = link_program(&object, 1, job->address, &vm.mem, NULL);
+    }
+    if (status >= 0) {
+        status = execute(&vm);
+    }
+
+    close_channel(&input);
+    if (close_channel(&output) && !status) {
+        status = PROG_ACC_ERR;
+    }
+    fclose(inputFile);
+    if (fclose(outputFile) && !status) {
+        status = PROG_ACC_ERR;
+    }
+
+    return status;
+}
+
+
+
+// ______________________________
+//             CORES
+// ______________________________
+
+
+
+// Runs the loaded program on several cores, each on its own thread, sharing the machine's memory and channels
+// Every core starts at the instruction pointer with its core number in the accumulator
+// Memory is written back once all cores stop, and the machine takes core 0's registers
+// Returns the first error any core stopped on
+int execute_cores( Machine *vm, size_t numCores ) {
+    Cluster *cluster = calloc(1, sizeof(Cluster));
+    if (NULL == cluster) { return PROG_ACC_ERR; }
+    cluster->vm = vm;
+    cluster->numCores = numCores;
+    cluster->running = numCores;
+    pthread_mutex_init(&cluster->ioLock, NULL);
+
+    double start = now_seconds();
+    size_t numStarted = 0;
+    for (; numStarted < numCores; numStarted++) {
+        Core *core = &cluster->cores[numStarted];
+        core->cluster = cluster;
+        core->instrPtr = vm->instrPtr;
+        core->accumulator = (WORD_TYPE) numStarted;
+        core->ioIntBuff = vm->ioIntBuff;
+        if (pthread_create(&core->thread, NULL, run_core, core)) { break; }
+    }
+    if (numStarted < numCores) {    // Cores that could start would wait on the others forever
+        __atomic_store_n(&cluster->running, 0, __ATOMIC_RELAXED);
+        for (size_t c = numStarted; c < numCores; c++) {
+            cluster->cores[c].status = PROG_ACC_ERR;
+        }
+    }
+    for (size_t c = 0; c < numStarted; c++) {
+        pthread_join(cluster->cores[c].thread, NULL);
+    }
+    double wallSeconds = now_seconds() - start;
+
+    // Report faults in core order
+    int status = 0;
+    for (size_t c = 0; c < numCores; c++) {
+        Core *core = &cluster->cores[c];
+        if (INV_ADDR == core->status) {
+            format_channel(vm->output, "\nCore %zu, word %zu - invalid memory address\n\n", c, core->instrPtr);
+        }
+        vm->instrCount += core->instrCount;
+        if (!status && INSTR_LIMIT != core->status) {
+            status = core->status;
+        }
+    }
+    flush_channel(vm->output);
+    print_cores(cluster, wallSeconds, stdout);
+
+    vm->instrPtr = cluster->cores[0].instrPtr;
+    vm->instrReg = cluster->cores[0].instrReg;
+    vm->accumulator = cluster->cores[0].accumulator;
+    pthread_mutex_destroy(&cluster->ioLock);
+    free(cluster);
+
+    if (vm->persist) {
+        memset(vm->mem.dirtyRows, 0xff, sizeof(vm->mem.dirtyRows));  // Stores weren't tracked
+        if (write_mem(&vm->mem)) { return MEM_ACC_ERR; }
+        sync_memf(&vm->mem);
+    }
+
+    return status;
+}
+
+
+
+// Runs a core until it ends, faults or reaches the instruction limit
+// Each instruction is fetched and decoded from shared memory, as other cores may store over code at any time
+void *run_core( void *arg ) {
+    Core *core = arg;
+    Cluster *cluster = core->cluster;
+    Machine *vm = cluster->vm;
+    Memory *mem = &vm->mem;
+
+    size_t ip = core->instrPtr;
+    Decoded instr;
+    size_t stored[2] = {0, 0};      // Words stored to by the instruction
+    char line[NUM_MEM_WORDS * sizeof(WORD_TYPE)];
+    WORD_TYPE text[NUM_MEM_WORDS];
+    size_t length = 0;
+    WORD_TYPE word = 0;
+    double start = now_seconds();
+
+    for (int done = 0; !done; ) {
+        if (vm->instrLimit && core->instrCount == vm->instrLimit) {
+            core->status = INSTR_LIMIT;
+            break;
+        }
+        if (ip < NUM_MEM_WORDS) {
+            decode_fields(SHARED_LOAD(mem, ip), 0, NUM_MEM_WORDS, &instr);
+        } else {
+            instr.handler = H_BAD_ADDR;
+        }
+
+        size_t next = ip + 1;
+        stored[0] = stored[1] = 0;
+        switch (instr.handler) {
+            // I/O, one core at a time
+            case H_RDI:
+                pthread_mutex_lock(&cluster->ioLock);
+                read_int(vm->input, &core->ioIntBuff);  // Keeps last value if none read
+                pthread_mutex_unlock(&cluster->ioLock);
+                SHARED_STORE(mem, instr.operand, core->ioIntBuff);
+                stored[0] = instr.operand;
+                stored[1] = instr.operand + 1;
+                break;
+            case H_RDS:     // Read whole, then stored a word at a time, keeping the high byte of an odd length's last word
+                pthread_mutex_lock(&cluster->ioLock);
+                length = read_line(vm->input, line, (NUM_MEM_WORDS - instr.operand) * sizeof(WORD_TYPE));
+                pthread_mutex_unlock(&cluster->ioLock);
+                stored[0] = instr.operand;
+                stored[1] = instr.operand + (length + sizeof(WORD_TYPE) - 1) / sizeof(WORD_TYPE);
+                for (size_t address = stored[0]; address < stored[1]; address++) {
+                    size_t offset = (address - stored[0]) * sizeof(WORD_TYPE);
+                    word = SHARED_LOAD(mem, address);
+                    memcpy(&word, &line[offset], length - offset < sizeof(WORD_TYPE) ? length - offset : sizeof(WORD_TYPE));
+                    SHARED_STORE(mem, address, word);
+                }
+                break;
+            case H_PRTI:
+                word = SHARED_LOAD(mem, instr.operand);
+                pthread_mutex_lock(&cluster->ioLock);
+                write_int(vm->output, word);
+                pthread_mutex_unlock(&cluster->ioLock);
+                break;
+            case H_PRTS:    // Copied out up to the word holding NUL
+                length = 0;
+                for (size_t address = instr.operand; address < NUM_MEM_WORDS; address++) {
+                    text[address - instr.operand] = SHARED_LOAD(mem, address);
+                    length = memchr(&text[address - instr.operand], '\0', sizeof(WORD_TYPE)) ? 0 : length + sizeof(WORD_TYPE);
+                    if (!length) {
+                        length = strlen((char *) text);
+                        break;
+                    }
+                }
+                pthread_mutex_lock(&cluster->ioLock);
+                write_bytes(vm->output, (char *) text, length);
+                write_bytes(vm->output, "\n", 1);
+                pthread_mutex_unlock(&cluster->ioLock);
+                break;
+
+            // Branches
+            case H_B:
+                next = instr.target;
+                break;
+            case H_BN:
+                next = core->accumulator < 0 ? instr.target : next;
+                break;
+            case H_BZ:
+                next = !core->accumulator ? instr.target : next;
+                break;
+
+            // Accumulator
+            case H_LOAD:
+                core->accumulator = SHARED_LOAD(mem, instr.operand);
+                break;
+            case H_STORE:
+                SHARED_STORE(mem, instr.operand, core->accumulator);
+                stored[0] = instr.operand;
+                stored[1] = instr.operand + 1;
+                break;
+            case H_ADD:
+                core->accumulator = (WORD_TYPE) (core->accumulator + SHARED_LOAD(mem, instr.operand));
+                break;
+            case H_SUB:
+                core->accumulator = (WORD_TYPE) (core->accumulator - SHARED_LOAD(mem, instr.operand));
+                break;
+
+            // Bulk memory, atomic word by word only
+            case H_BCPY:
+            case H_BFIL:
+            case H_BCMP:
+            case H_BSCH:
+            case H_BADD:
+                core->status = shared_bulk(mem, instr.handler, instr.operand, &core->accumulator, stored);
+                done = 0 != core->status;
+                next = done ? ip : next;
+                break;
+
+            // Atomics
+            case H_CAS:     // Swap in the following word if the word holds the accumulator
+                word = core->accumulator;
+                core->numAtomics++;
+                if (__atomic_compare_exchange_n(&mem->words[instr.operand], &word, SHARED_LOAD(mem, instr.operand + 1), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                    stored[0] = instr.operand;
+                    stored[1] = instr.operand + 1;
+                } else {
+                    core->numCasFailed++;
+                }
+                core->accumulator = word;   // Old value either way
+                break;
+            case H_FADD:
+                core->numAtomics++;
+                core->accumulator = __atomic_fetch_add(&mem->words[instr.operand], core->accumulator, __ATOMIC_SEQ_CST);
+                stored[0] = instr.operand;
+                stored[1] = instr.operand + 1;
+                break;
+            case H_WAIT:    // Sleep while the word holds the accumulator, unless no other core could change it
+                if (SHARED_LOAD(mem, instr.operand) == core->accumulator && __atomic_load_n(&cluster->running, __ATOMIC_RELAXED) > 1) {
+                    double waitStart = now_seconds();
+                    wait_word(cluster, &mem->words[instr.operand], core->accumulator);
+                    core->waitSeconds += now_seconds() - waitStart;
+                    core->numWaits++;
+                }
+                break;
+
+            case H_END:
+                done = 1;
+                next = ip;
+                break;
+            case H_BAD_ADDR:
+                core->status = INV_ADDR;
+                done = 1;
+                next = ip;
+                break;
+        }
+
+        if (stored[1] > stored[0] && __atomic_load_n(&cluster->waiters, __ATOMIC_RELAXED)) {
+            wake_words(cluster, stored[0], stored[1] - stored[0]);
+        }
+        core->instrCount += !done;
+        ip = next;
+    }
+
+    core->instrPtr = ip;
+    core->instrReg = ip < NUM_MEM_WORDS ? SHARED_LOAD(mem, ip) : 0;
+    core->execSeconds = now_seconds() - start;
+    __atomic_fetch_sub(&cluster->running, 1, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+
+
+
+// Runs a bulk instruction as execute_bulk() does, loading and storing shared memory a word at a time
+// Stores aren't marked dirty, as every row is written back once all cores stop
+// Sets the range of words stored to
+// Returns INV_ADDR, with memory unchanged, if the parameter block or a range is outside of memory
+int shared_bulk( Memory *mem, int handler, size_t params, WORD_TYPE *accumulator, size_t stored[2] ) {
+    stored[0] = stored[1] = 0;
+    if (params + 3 > NUM_MEM_WORDS) { return INV_ADDR; }
+
+    size_t dstAddress = (unsigned short) SHARED_LOAD(mem, params);
+    WORD_TYPE value = SHARED_LOAD(mem, params + 1);
+    size_t srcAddress = (unsigned short) value;
+    size_t count = (unsigned short) SHARED_LOAD(mem, params + 2);
+    int hasSource = H_BCPY == handler || H_BCMP == handler || H_BADD == handler;
+    if (dstAddress + count > NUM_MEM_WORDS || (hasSource && srcAddress + count > NUM_MEM_WORDS)) { return INV_ADDR; }
+
+    WORD_TYPE src[NUM_MEM_WORDS];   // Source read in full first, as it may overlap the destination
+    for (size_t i = 0; hasSource && i < count; i++) {
+        src[i] = SHARED_LOAD(mem, srcAddress + i);
+    }
+
+    size_t index = 0;
+    switch (handler) {
+        case H_BCPY:
+            for (size_t i = 0; i < count; i++) {
+                SHARED_STORE(mem, dstAddress + i, src[i]);
+            }
+            break;
+        case H_BFIL:
+            for (size_t i = 0; i < count; i++) {
+                SHARED_STORE(mem, dstAddress + i, value);
+            }
+            break;
+        case H_BCMP:
+            for (WORD_TYPE word; index < count; index++) {
+                word = SHARED_LOAD(mem, dstAddress + index);
+                if (word != src[index]) {
+                    *accumulator = word < src[index] ? -1 : 1;
+                    return 0;
+                }
+            }
+            *accumulator = 0;
+            return 0;
+        case H_BSCH:
+            while (index < count && SHARED_LOAD(mem, dstAddress + index) != value) {
+                index++;
+            }
+            *accumulator = index == count ? -1 : (WORD_TYPE) index;
+            return 0;
+        case H_BADD:
+            for (size_t i = 0; i < count; i++) {
+                SHARED_STORE(mem, dstAddress + i, SHARED_LOAD(mem, dstAddress + i) + src[i]);
+            }
+            break;
+    }
+
+    stored[0] = dstAddress;
+    stored[1] = dstAddress + count;
+
+    return 0;
+}
+
+
+
+// Sleeps while a shared word holds a value, until a store to it wakes the core or the wait times out
+// The futex is the aligned 32 bit word holding the TIMS word
+void wait_word( Cluster *cluster, WORD_TYPE *word, WORD_TYPE value ) {
+    struct timespec timeout = {0, CORE_WAIT_NS};
+#ifdef FUTEX_SUPPORTED
+    int *futex = (int *) ((unsigned long) word & ~3ul);
+    __atomic_fetch_add(&cluster->waiters, 1, __ATOMIC_SEQ_CST);
+    int current = __atomic_load_n(futex, __ATOMIC_SEQ_CST);
+    WORD_TYPE held;
+    memcpy(&held, (char *) &current + ((unsigned long) word & 3), sizeof(WORD_TYPE));
+    if (held == value) {    // The kernel sleeps only if the futex still holds current
+        syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, current, &timeout, NULL, 0);
+    }
+    __atomic_fetch_sub(&cluster->waiters, 1, __ATOMIC_SEQ_CST);
+#elif defined(__unix__)
+    (void) cluster;
+    (void) word;
+    (void) value;
+    nanosleep(&timeout, NULL);
+#endif
+}
+
+
+
+// Wakes every core sleeping on a range of shared words
+void wake_words( Cluster *cluster, size_t first, size_t count ) {
+#ifdef FUTEX_SUPPORTED
+    for (unsigned long futex = (unsigned long) &cluster->vm->mem.words[first] & ~3ul;
+            futex < (unsigned long) &cluster->vm->mem.words[first + count]; futex += sizeof(int)) {
+        syscall(SYS_futex, (int *) futex, FUTEX_WAKE_PRIVATE, MAX_CORES, NULL, NULL, 0);
+    }
+#else
+    (void) cluster;
+    (void) first;
+    (void) count;
+#endif
+}
+
+
+
+// Prints each core's instruction rate, atomics and waits, and the rate of all cores together
+void print_cores( Cluster *cluster, double wallSeconds, FILE *report ) {
+    size_t total = 0;
+
+    fputs("\nCORES:\n", report);
+    fprintf(report, "%-6s%14s%12s%12s%12s%12s%10s%12s\n", "Core", "Instructions", "Seconds", "Instr/s", "Atomics", "CAS failed", "Waits", "Wait s");
+    for (size_t c = 0; c < cluster->numCores; c++) {
+        Core *core = &cluster->cores[c];
+        double busySeconds = core->execSeconds - core->waitSeconds;
+        fprintf(report, "%-6zu%14llu%12.6f%12.0f%12llu%12llu%10llu%12.6f\n", c, (unsigned long long) core->instrCount, core->execSeconds,
+                busySeconds > 0 ? core->instrCount / busySeconds : 0, (unsigned long long) core->numAtomics,
+                (unsigned long long) core->numCasFailed, (unsigned long long) core->numWaits, core->waitSeconds);
+        total += core->instrCount;
+    }
+    fprintf(report, "%-6s%14llu%12.6f%12.0f\n\n", "All", (unsigned long long) total, wallSeconds, wallSeconds > 0 ? total / wallSeconds : 0);
+}
+
+
+
+// ______________________________
+//           SCHEDULER
+// ______________________________
+
+
+
+// Runs every job of a manifest as an interactive session, multiplexed on this thread
+// Each turn runs a session for a time slice of instructions, then moves on to the next runnable session
+// Sessions reading input yet to arrive sleep in an epoll set until their input is readable
+int run_sessions( char manifestName[], size_t slice, char *mnemonics[], WORD_TYPE opcodes[] ) {
+#ifdef EPOLL_SUPPORTED
+    Batch batch = {NULL, 0, NULL, 0};
+    char *manifest = NULL;
+    int status = load_manifest(manifestName, &batch, &manifest, mnemonics, opcodes);
+    if (status) { return status; }
+
+    // Runnable sessions wait their turn in a ring, which holds every session at most once
+    Session *sessions = calloc(batch.numJobs, sizeof(Session));
+    size_t *runQueue = calloc(batch.numJobs + 1, sizeof(size_t));
+    int events = epoll_create1(0);
+    if (NULL == sessions || NULL == runQueue || events < 0) {
+        if (events >= 0) {
+            close(events);
+        }
+        free(runQueue);
+        free(sessions);
+        free(batch.jobs);
+        free(manifest);
+        return PROG_ACC_ERR;
+    }
+
+    size_t head = 0, tail = 0;
+    size_t numLive = 0;
+    for (size_t j = 0; j < batch.numJobs; j++) {
+        batch.jobs[j].status = open_session(&sessions[j], &batch.jobs[j]);
+        if (batch.jobs[j].status) { continue; }
+        sessions[j].vm.instrLimit = slice;
+        runQueue[tail++] = j;
+        numLive++;
+    }
+
+    size_t numSlices = 0;
+    size_t numWaits = 0;
+    double start = now_seconds();
+    struct epoll_event ready[SCHED_MAX_EVENTS];
+    while (numLive) {
+        // Wake sessions whose input arrived, sleeping only when none can run
+        // A FIFO only becomes readable or hung up once a writer has opened it
+        int numReady = epoll_wait(events, ready, SCHED_MAX_EVENTS, head == tail ? -1 : 0);
+        for (int e = 0; e < numReady; e++) {
+            size_t s = (Session *) ready[e].data.ptr - sessions;
+            epoll_ctl(events, EPOLL_CTL_DEL, fileno(sessions[s].inputFile), NULL);
+            sessions[s].input.writerPending = 0;
+            runQueue[tail] = s;
+            tail = (tail + 1) % (batch.numJobs + 1);
+        }
+        if (head == tail) { continue; }
+
+        size_t s = runQueue[head];
+        head = (head + 1) % (batch.numJobs + 1);
+        Session *session = &sessions[s];
+        session->numSlices++;
+        numSlices++;
+
+        status = execute(&session->vm);
+        if (INSTR_LIMIT == status) {        // Slice used up
+            runQueue[tail] = s;
+            tail = (tail + 1) % (batch.numJobs + 1);
+        } else if (INPUT_WAIT == status) {  // Sleep until readable, files always being readable
+            struct epoll_event wait = {EPOLLIN, {.ptr = session}};
+            session->numWaits++;
+            numWaits++;
+            if (epoll_ctl(events, EPOLL_CTL_ADD, fileno(session->inputFile), &wait)) {
+                runQueue[tail] = s;
+                tail = (tail + 1) % (batch.numJobs + 1);
+            }
+        } else {
+            session->job->status = close_session(session, status);
+            numLive--;
+        }
+    }
+    double seconds = now_seconds() - start;
+
+    // Report failed sessions in manifest order
+    unsigned int numFailed = 0;
+    for (size_t j = 0; j < batch.numJobs; j++) {
+        if (batch.jobs[j].status) {
+            printf("Session %zu - \"%s\" failed (%d)\n", j + 1, batch.jobs[j].program, batch.jobs[j].status);
+            numFailed++;
+        }
+    }
+    printf("\nRan %zu sessions on one thread in %zu slices of %zu instructions, %zu waits for input, %u failed, %.6f s\n\n",
+            batch.numJobs, numSlices, slice, numWaits, numFailed, seconds);
+
+    close(events);
+    free(runQueue);
+    free(sessions);
+    free(batch.jobs);
+    free(manifest);
+
+    return numFailed ? BAD_PROGRAM : 0;
+#else
+    (void) manifestName;
+    (void) slice;
+    (void) mnemonics;
+    (void) opcodes;
+    puts("Sessions need epoll");
+    return PROG_ACC_ERR;
+#endif
+}
+
+
+
+// Opens a session's input without blocking and its output, then links its program on a private machine
+int open_session( Session *session, Job *job ) {
+    session->job = job;
+
+#ifdef __unix__
+    // Opening a pipe for reading doesn't wait for a writer
+    int inputFd = open(job->input, O_RDONLY | O_NONBLOCK);
+    session->inputFile = inputFd < 0 ? NULL : fdopen(inputFd, "rb");
+    if (NULL == session->inputFile) {
+        if (inputFd >= 0) {
+            close(inputFd);
+        }
+        return PROG_ACC_ERR;
+    }
+#else
+    session->inputFile = fopen(job->input, "rb");
+    if (NULL == session->inputFile) { return PROG_ACC_ERR; }
+#endif
+    session->outputFile = fopen(job->output, "wb");
+    if (NULL == session->outputFile) {
+        fclose(session->inputFile);
+        return PROG_ACC_ERR;
+    }
+
+    int status = open_channel(&session->input, session->inputFile) | open_channel(&session->output, session->outputFile);
+    session->input.nonblocking = 1;
+#ifdef __unix__
+    struct stat info;
+    session->input.writerPending = !fstat(inputFd, &info) && S_ISFIFO(info.st_mode);
+#endif
+
+    init_machine(&session->vm, &session->input, &session->output);
+    session->vm.instrPtr = job->address;
+
+    char *object = job->object;
+    if (!status) {
+        status = link_program(&object, 1, job->address, &session->vm.mem, NULL);
+    }
+    if (status < 0) {
+        return close_session(session, status);
+    }
+
+    return 0;
+}
+
+
+
+// Closes a session's channels and files
+// Returns the session's status, or the first error closing it
+int close_session( Session *session, int status ) {
+    close_channel(&session->input);
+    if (close_channel(&session->output) && !status) {
+        status = PROG_ACC_ERR;
+    }
+    fclose(session->inputFile);
+    if (fclose(session->outputFile) && !status) {
+        status = PROG_ACC_ERR;
+    }
+
+    return status;
+}
+
+
+
+// ______________________________
+//           BENCHMARKS
+// ______________________________
+
+
+
+// Runs every benchmark through assembly, loading and execution and reports the measurements
+// The report is JSON if its name ends in ".json", else CSV
+// Runs on the JIT if useJit is set
+int run_benchmarks( char reportName[], int useJit, char *mnemonics[], WORD_TYPE opcodes[] ) {
+    const char *names[NUM_BENCHMARKS] = {"branch", "straight", "int_io", "str_io", "assembler", "bulk", "counter"};
+    BenchResult results[NUM_BENCHMARKS];
+
+    for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+        printf("Running benchmark \"%s\"\n", names[b]);
+        int status = run_benchmark(b, useJit, mnemonics, opcodes, &results[b]);
+        if (status) {
+            printf("\nBenchmark \"%s\" failed (%d)\n\n", names[b], status);
+            return status;
+        }
+    }
+
+    if (write_report(reportName, names, results)) { return PROG_ACC_ERR; }
+    printf("\nWrote benchmark report to \"%s\"\n\n", reportName);
+
+    return 0;
+}
+
+
+
+// Generates, assembles, loads and runs a benchmark on a private machine,
+// then on the interpreter again from the same image and input with superinstructions fused
+int run_benchmark( size_t benchmark, int useJit, char *mnemonics[], WORD_TYPE opcodes[], BenchResult *result ) {
+    char directory[PATH_SIZE] = ".";
+    char sourceName[PATH_SIZE];
+    char objectName[PATH_SIZE];
+    char *objectNames[1] = {objectName};
+
+    memset(result, 0, sizeof(BenchResult));
+
+#ifdef __unix__
+    // Source and object go in a private temporary directory, clear of the user's files
+    const char *tmpDir = getenv("TMPDIR");
+    snprintf(directory, sizeof(directory), "%s/timsbenchXXXXXX", NULL == tmpDir ? "/tmp" : tmpDir);
+    if (NULL == mkdtemp(directory)) { return PROG_ACC_ERR; }
+#endif
+    snprintf(sourceName, sizeof(sourceName), "%s/bench%zu.txt", directory, benchmark);
+    strcpy(objectName, sourceName);
+
+    // Program input and output stay in temporary files
+    FILE *source = fopen(sourceName, "wb");
+    FILE *inputFile = tmpfile();
+    FILE *outputFile = tmpfile();
+    if (NULL == source || NULL == inputFile || NULL == outputFile) {
+        if (NULL != source) { fclose(source); }
+        if (NULL != inputFile) { fclose(inputFile); }
+        if (NULL != outputFile) { fclose(outputFile); }
+        remove(sourceName);
+#ifdef __unix__
+        rmdir(directory);
+#endif
+        return PROG_ACC_ERR;
+    }
+    result->asmLines = generate_benchmark(benchmark, source, inputFile);
+    fclose(source);
+    fflush(inputFile);
+    rewind(inputFile);
+
+    // Assemble
+    double start = now_seconds();
+    int status = assemble_program(objectName, mnemonics, opcodes, 0, stdout);
+    result->asmSeconds = now_seconds() - start;
+
+    // Load and execute up to the instruction limit
+    Channel input, output;
+    int channelStatus = open_channel(&input, inputFile) | open_channel(&output, outputFile);
+    Machine vm;
+    init_machine(&vm, &input, &output);
+    size_t instrLimit = BENCH_INT_IO == benchmark || BENCH_STR_IO == benchmark || BENCH_BULK == benchmark ? BENCH_IO_INSTRUCTIONS : BENCH_INSTRUCTIONS;
+    vm.instrLimit = instrLimit;
+
+    if (!status && BENCH_ASSEMBLER != benchmark) {
+        status = channelStatus ? channelStatus : link_program(objectNames, 1, 0, &vm.mem, NULL);
+        if (status >= 0) {
+            Memory loaded = vm.mem;
+            result->numWords = status;
+            start = now_seconds();
+            status = useJit ? execute_jit(&vm) : execute(&vm);
+            result->execSeconds = now_seconds() - start;
+            result->instructions = result->dispatches = vm.instrCount;
+
+            // Again, fused
+            if (INSTR_LIMIT == status) {
+                rewind(inputFile);
+                input.start = input.length = 0;
+                input.eof = 0;
+                init_machine(&vm, &input, &output);
+                vm.mem = loaded;
+                vm.instrLimit = instrLimit;
+                start = now_seconds();
+                status = execute_fused(&vm, NULL);
+                result->fusedSeconds = now_seconds() - start;
+                result->dispatches = vm.instrCount - vm.fusedCount;
+            }
+        }
+        if (INSTR_LIMIT == status) {
+            status = 0;
+        }
+    }
+    result->peakRss = peak_rss();
+
+    close_channel(&input);
+    close_channel(&output);
+    fclose(inputFile);
+    fclose(outputFile);
+    remove(sourceName);
+    remove(objectName);
+#ifdef __unix__
+    rmdir(directory);
+#endif
+
+    return status;
+}
+
+
+
+// Writes a benchmark's TIMS source and any program input
+// Returns the number of source lines
+size_t generate_benchmark( size_t benchmark, FILE *source, FILE *input ) {
+    size_t numLines = 0;
+
+    switch (benchmark) {
+        case BENCH_BRANCH:      // Taken BZ, untaken BN and B each pass
+            fputs("A0: bz A1\nA1: bn A0\nA2: b A0\n", source);
+            numLines = 3;
+            break;
+        case BENCH_STRAIGHT:    // Untaken branches to the end of memory
+            for (numLines = 0; numLines < NUM_MEM_WORDS - 1; numLines++) {
+                fprintf(source, "%sbn A0\n", numLines ? "" : "A0: ");
+            }
+            fputs("b A0\n", source);
+            numLines++;
+            break;
+        case BENCH_INT_IO:      // Echo integers
+            fputs("A0: rdi A3\nA1: prti A3\nA2: b A0\nA3: 0\n", source);
+            numLines = 4;
+            for (size_t i = 0; i < BENCH_IO_INSTRUCTIONS / 3 + 1; i++) {
+                fprintf(input, "%d\n", (int) (i % 65536) - 32768);
+            }
+            break;
+        case BENCH_STR_IO:      // Echo lines
+            fputs("A0: rds A3\nA1: prts A3\nA2: b A0\nA3: 0\n", source);
+            numLines = 4;
+            for (size_t i = 0; i < BENCH_IO_INSTRUCTIONS / 3 + 1; i++) {
+                fprintf(input, "TIMS benchmark line %zu\n", i);
+            }
+            break;
+        case BENCH_ASSEMBLER:   // Forward and backward label references, lone labels and literals
+            for (numLines = 0; numLines < BENCH_ASM_LINES; numLines++) {
+                switch (numLines % 4) {
+                    case 0: fprintf(source, "L%zu: b L%zu\n", numLines, numLines + 4); break;
+                    case 1: fprintf(source, "bz L%zu\n", numLines / 2 / 4 * 4); break;
+                    case 2: fprintf(source, "l%zu:\n", numLines); break;
+                    case 3: fprintf(source, "  0x%04zx\n", numLines % 0x10000); break;
+                }
+            }
+            fprintf(source, "L%zu: end\n", numLines);
+            numLines++;
+            break;
+        case BENCH_BULK:        // Parameter blocks hold absolute addresses, as loaded at word 0
+            fputs("A0: bcpy P0\nbfil P1\nbadd P0\nbcmp P0\nb A0\n", source);
+            fputs("P0: 60\n20\n40\nP1: 20\n7\n40\n", source);
+            numLines = 11;
+            break;
+        case BENCH_COUNTER:     // Count one up and another down, restarting it below zero
+            fputs("A0: load N\nadd ONE\nstore N\nload M\nsub ONE\nstore M\nbn A1\nb A0\n", source);
+            fputs("A1: load K\nstore M\nb A0\nN: 0\nM: 1000\nK: 1000\nONE: 1\n", source);
+            numLines = 15;
+            break;
+    }
+
+    return numLines;
+}
+
+
+
+// Writes benchmark results as CSV, or as JSON if the report name ends in ".json"
+int write_report( char reportName[], const char *names[], BenchResult results[] ) {
+    FILE *report = fopen(reportName, "w");
+    if (NULL == report) { return PROG_ACC_ERR; }
+
+    size_t nameLen = strlen(reportName);
+    int json = nameLen >= 5 && !strcmp(&reportName[nameLen - 5], ".json");
+
+    if (json) {
+        fputs("[\n", report);
+    } else {
+        fputs("benchmark,words,asm_lines,asm_seconds,asm_lines_per_sec,instructions,exec_seconds,instr_per_sec,ns_per_dispatch,"
+                "fused_dispatches,dispatch_reduction_pct,fused_seconds,fusion_speedup,peak_rss_kb\n", report);
+    }
+
+    for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+        BenchResult *result = &results[b];
+        double asmRate = result->asmSeconds > 0 ? result->asmLines / result->asmSeconds : 0;
+        double instrRate = result->execSeconds > 0 ? result->instructions / result->execSeconds : 0;
+        double dispatchNs = result->instructions ? 1e9 * result->execSeconds / result->instructions : 0;
+        double reduction = result->instructions ? 100.0 * (result->instructions - result->dispatches) / result->instructions : 0;
+        double speedup = result->fusedSeconds > 0 ? result->execSeconds / result->fusedSeconds : 0;
+
+        if (json) {
+            fprintf(report, "  {\"benchmark\": \"%s\", \"words\": %zu, \"asm_lines\": %zu, \"asm_seconds\": %.6f, \"asm_lines_per_sec\": %.0f, "
+                    "\"instructions\": %zu, \"exec_seconds\": %.6f, \"instr_per_sec\": %.0f, \"ns_per_dispatch\": %.3f, "
+                    "\"fused_dispatches\": %zu, \"dispatch_reduction_pct\": %.2f, \"fused_seconds\": %.6f, \"fusion_speedup\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+                    names[b], result->numWords, result->asmLines, result->asmSeconds, asmRate,
+                    result->instructions, result->execSeconds, instrRate, dispatchNs,
+                    result->dispatches, reduction, result->fusedSeconds, speedup, result->peakRss, b + 1 < NUM_BENCHMARKS ? "," : "");
+        } else {
+            fprintf(report, "%s,%zu,%zu,%.6f,%.0f,%zu,%.6f,%.0f,%.3f,%zu,%.2f,%.6f,%.3f,%ld\n",
+                    names[b], result->numWords, result->asmLines, result->asmSeconds, asmRate,
+                    result->instructions, result->execSeconds, instrRate, dispatchNs,
+                    result->dispatches, reduction, result->fusedSeconds, speedup, result->peakRss);
+        }
+    }
+
+    if (json) {
+        fputs("]\n", report);
+    }
+
+    return fclose(report) ? PROG_ACC_ERR : 0;
+}
+
+
+
+// Returns seconds from a monotonic clock where available, else processor time
+double now_seconds( void ) {
+#if defined(__unix__) && defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+
+// Returns the peak resident memory of the process in kilobytes, 0 if unknown
+long int peak_rss( void ) {
+#ifdef __unix__
+    struct rusage usage;
+    if (!getrusage(RUSAGE_SELF, &usage)) {
+        return usage.ru_maxrss;
+    }
+#endif
+    return 0;
+}
+
+
+
+// ______________________________
+//            LIBRARY
+// ______________________________
+
+
+
+// Creates a machine for embedding, reading RDI/RDS input from one stream and writing PRTI/PRTS output to another
+// Instances leave the memory files alone, so many can run side by side in one process
+// Returns NULL if out of memory
+Instance *create_instance( FILE *input, FILE *output ) {
+    Instance *instance = malloc(sizeof(Instance));
+    if (NULL == instance) { return NULL; }
+
+    if (open_channel(&instance->input, input) | open_channel(&instance->output, output)) {
+        free(instance->input.data);
+        free(instance->output.data);
+        free(instance);
+        return NULL;
+    }
+    init_machine(&instance->vm, &instance->input, &instance->output);
+    memset(instance->image, 0, sizeof(instance->image));
+    instance->entry = 0;
+
+    return instance;
+}
+
+
+
+// Links object modules from the given address into otherwise cleared memory and resets the machine to run them
+// Returns the number of words loaded, else an error with the machine left cleared
+int load_instance( Instance *instance, char *objectNames[], size_t numModules, size_t address ) {
+    Machine *vm = &instance->vm;
+    memset(vm->mem.words, 0, sizeof(vm->mem.words));
+
+    int numWords = link_program(objectNames, numModules, address, &vm->mem, NULL);
+    if (numWords < 0) {
+        memset(vm->mem.words, 0, sizeof(vm->mem.words));
+    }
+    memcpy(instance->image, vm->mem.words, sizeof(instance->image));
+    instance->entry = numWords < 0 ? 0 : address;
+    reset_instance(instance);
+
+    return numWords;
+}
+
+
+
+// Runs a machine for at most numInstrs instructions, 0 for no limit
+// Returns INSTR_LIMIT if stopped by the limit, ready to run on, 0 at END, else the error it stopped on
+int run_instance( Instance *instance, size_t numInstrs ) {
+    instance->vm.instrLimit = numInstrs;
+    int status = execute(&instance->vm);
+    instance->vm.instrLimit = 0;
+
+    return status;
+}
+
+
+
+// Reads a machine's registers and the instructions it has run since its last reset
+void query_instance( Instance *instance, MachineState *state ) {
+    state->instrPtr = instance->vm.instrPtr;
+    state->instrReg = instance->vm.instrReg;
+    state->accumulator = instance->vm.accumulator;
+    state->instrCount = instance->vm.instrCount;
+}
+
+
+
+// Returns a machine to its loaded image with cleared registers, ready to run from the load address again
+// Only the memory rows stored to since the load are copied back, and unread input is dropped
+void reset_instance( Instance *instance ) {
+    Machine *vm = &instance->vm;
+
+    for (size_t row = 0; row < NUM_MEMF_ROWS; row++) {
+        if (!(vm->mem.dirtyRows[row / 8] & (1 << (row % 8)))) { continue; }
+
+        size_t first = row * MEMF_COLS;
+        size_t numWords = first + MEMF_COLS < NUM_MEM_WORDS ? MEMF_COLS : NUM_MEM_WORDS - first;
+        memcpy(&vm->mem.words[first], &instance->image[first], numWords * sizeof(WORD_TYPE));
+    }
+    memset(vm->mem.dirtyRows, 0, sizeof(vm->mem.dirtyRows));
+
+    vm->instrPtr = instance->entry;
+    vm->instrReg = 0;
+    vm->accumulator = 0;
+    vm->ioIntBuff = 0;
+    vm->instrCount = 0;
+    instance->input.start = instance->input.length = 0;
+    instance->input.eof = 0;
+}
+
+
+
+// Flushes a machine's output and frees it, leaving its streams open
+void destroy_instance( Instance *instance ) {
+    if (NULL == instance) { return; }
+
+    instance->input.length = 0;     // Nothing to write back
+    close_channel(&instance->input);
+    close_channel(&instance->output);
+    free(instance);
+}
+
+
+
+// ______________________________
+//           LIVE VIEW
+// ______________________________
+
+
+
+// Creates, or opens again, the named POSIX shared-memory live view and maps it for publishing
+// The view outlives the machine, holding its final state for viewers as the memory files do
+// Returns NULL if shared memory is unsupported or unavailable
+LiveView *open_live( char name[] ) {
+#ifdef LIVE_SUPPORTED
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) { return NULL; }
+    if (ftruncate(fd, sizeof(LiveView))) {
+        close(fd);
+        return NULL;
+    }
+
+    LiveView *view = mmap(NULL, sizeof(LiveView), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == view) { return NULL; }
+
+    // Mark as being written until the first publish, whatever an earlier machine left
+    __atomic_store_n(&view->sequence, view->sequence | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(view->magic, LIVE_MAGIC, sizeof(view->magic));
+    view->version = LIVE_VERSION;
+
+    return view;
+#else
+    return NULL;
+#endif
+}
+
+
+
+// Unmaps a live view, leaving the shared memory to viewers
+void close_live( LiveView *view ) {
+#ifdef LIVE_SUPPORTED
+    if (NULL != view) {
+        munmap(view, sizeof(LiveView));
+    }
+#endif
+}
+
+
+
+// Publishes a machine's registers and base memory under the view's seqlock
+// instrCount counts on from the instructions the machine had run before this execution
+void publish_live( LiveView *view, Machine *vm, size_t ip, size_t instrCount ) {
+    unsigned int sequence = __atomic_load_n(&view->sequence, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&view->sequence, sequence | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    view->instrPtr = ip;
+    view->instrCount = vm->instrCount + instrCount;
+    view->instrReg = read_word(&vm->mem, ip);
+    view->accumulator = vm->accumulator;
+    memcpy(view->words, vm->mem.words, sizeof(view->words));
+    __atomic_store_n(&view->sequence, (sequence | 1) + 1, __ATOMIC_RELEASE);
+}
 
-    WORD_TYPE buffer[NUM_MEM_WORDS] = {0x0};    // Initialize memory write buffer
 
-    // Clear memory file
-    if (NUM_MEM_WORDS != fwrite(buffer, sizeof(WORD_TYPE), NUM_MEM_WORDS, memory)) {
-        return MEM_ACC_ERR;
-    }
 
-    rewind(memory); // Rewind offset so sync_memf() will close memory
+// Copies a live view, retrying until no publish overlapped the copy
+void read_live( const LiveView *view, LiveView *snapshot ) {
+    unsigned int sequence;
 
-    int syncReturn = sync_memf(memory);  // Sync memf
+    do {
+        sequence = __atomic_load_n(&view->sequence, __ATOMIC_ACQUIRE);
+        memcpy(snapshot, view, sizeof(LiveView));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || sequence != __atomic_load_n(&view->sequence, __ATOMIC_RELAXED));
+}
+
+
+
+// Prints the registers and memory of a live view, memory as the formatted memory file lays it out
+int view_live( char name[], FILE *report ) {
+#ifdef LIVE_SUPPORTED
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) { return MEM_ACC_ERR; }
+
+    struct stat info;
+    if (fstat(fd, &info) || info.st_size < (off_t) sizeof(LiveView)) {
+        close(fd);
+        return BAD_VIEW;
+    }
+    LiveView *view = mmap(NULL, sizeof(LiveView), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == view) { return MEM_ACC_ERR; }
+
+    LiveView snapshot;
+    int status = memcmp(view->magic, LIVE_MAGIC, sizeof(view->magic)) || LIVE_VERSION != view->version ? BAD_VIEW : 0;
+    if (!status) {
+        read_live(view, &snapshot);
+    }
+    munmap(view, sizeof(LiveView));
+    if (status) { return status; }
+
+    fprintf(report, "\nREGISTERS:\n");
+    fprintf(report, "%-24s0x%02x\n", "Instruction Pointer", snapshot.instrPtr);
+    fprintf(report, "%-22s0x%04x\n", "Instruction Register", snapshot.instrReg);
+    fprintf(report, "%-22s0x%04x\n", "Accumulator", snapshot.accumulator);
+    fprintf(report, "%-24s%llu\n\n", "Instructions", snapshot.instrCount);
+
+    fputs(MEMF_HEADER, report);
+    for (size_t row = 0; row < NUM_MEMF_ROWS; row++) {
+        write_memf_row(report, snapshot.words, row);
+    }
+
+    return 0;
+#else
+    return MEM_ACC_ERR;
+#endif
+}
+
+
+
+// ______________________________
+//             MEMORY
+// ______________________________
+
+
+
+// Places relocated program words in a memory image
+void place_words( Memory *mem, WORD_TYPE words[], size_t numWords, size_t address ) {
+    memcpy(&mem->words[address], words, numWords * sizeof(WORD_TYPE));
+    for (size_t word = address; word < address + numWords; word++) {
+        mark_dirty(mem, word);
+    }
+}
+
+
+
+// Reads the TIMS memory file into a RAM memory image
+// Base memory is followed by a record for each populated page of extended memory
+int read_mem( Memory *mem ) {
+    FILE *memory = fopen(MEMORY, "r");  // Open memory
+    if (NULL == memory) { return MEM_ACC_ERR; }
+
+    // Read TIMS memory contents
+    if (NUM_MEM_WORDS != fread(mem->words, sizeof(WORD_TYPE), NUM_MEM_WORDS, memory)) {
+        fclose(memory);
+        return MEM_ACC_ERR;
+    }
+
+    // Read extended memory pages
+    unsigned int page = 0;
+    int status = 0;
+    while (!status && 1 == fread(&page, sizeof(page), 1, memory)) {
+        if (page >= EXT_NUM_PAGES || (NULL == mem->pages && init_pages(mem))) {
+            status = MEM_ACC_ERR;
+            break;
+        }
+        if (NULL == mem->pages[page]) {
+            mem->pages[page] = malloc(EXT_PAGE_WORDS * sizeof(WORD_TYPE));
+        }
+        if (NULL == mem->pages[page] || EXT_PAGE_WORDS != fread(mem->pages[page], sizeof(WORD_TYPE), EXT_PAGE_WORDS, memory)) {
+            status = MEM_ACC_ERR;
+        }
+    }
+
+    if (fclose(memory) || status) {
+        free_pages(mem);
+        return MEM_ACC_ERR;
+    }
+
+    memset(mem->dirtyRows, 0, sizeof(mem->dirtyRows));  // Image matches synced memory
+
+    return 0;
+}
+
+
+
+// Writes a RAM memory image back to the TIMS memory file
+// Extended memory rewrites the file with its populated pages, leaving untouched pages out
+int write_mem( Memory *mem ) {
+    FILE *memory = fopen(MEMORY, NULL == mem->pages ? "r+" : "wb"); // Open memory
+    if (NULL == memory) { return MEM_ACC_ERR; }
+
+    // Write TIMS memory contents
+    if (NUM_MEM_WORDS != fwrite(mem->words, sizeof(WORD_TYPE), NUM_MEM_WORDS, memory)) {
+        fclose(memory);
+        return MEM_ACC_ERR;
+    }
+
+    // Write extended memory pages
+    for (unsigned int page = 0; NULL != mem->pages && page < EXT_NUM_PAGES; page++) {
+        if (NULL == mem->pages[page]) { continue; }
+        if (1 != fwrite(&page, sizeof(page), 1, memory)
+                || EXT_PAGE_WORDS != fwrite(mem->pages[page], sizeof(WORD_TYPE), EXT_PAGE_WORDS, memory)) {
+            fclose(memory);
+            return MEM_ACC_ERR;
+        }
+    }
+
+    if (fclose(memory)) { return MEM_ACC_ERR; }
+
+    return 0;
+}
+
+
+
+// Allocates an empty extended memory page table, enabling extended addressing
+int init_pages( Memory *mem ) {
+    mem->pages = calloc(EXT_NUM_PAGES, sizeof(WORD_TYPE *));
+
+    return NULL == mem->pages ? MEM_ACC_ERR : 0;
+}
+
+
+
+// Frees extended memory pages and their table
+void free_pages( Memory *mem ) {
+    for (size_t page = 0; NULL != mem->pages && page < EXT_NUM_PAGES; page++) {
+        free(mem->pages[page]);
+    }
+    free(mem->pages);
+    mem->pages = NULL;
+}
+
+
+
+// Returns the word at a base or extended memory address, allocating its page on first store
+// Returns NULL outside of memory or on an untouched page when not allocating
+WORD_TYPE *page_word( Memory *mem, size_t address, int allocate ) {
+    if (address < NUM_MEM_WORDS) {
+        return &mem->words[address];
+    }
+    if (NULL == mem->pages || address >= EXT_NUM_WORDS) { return NULL; }
+
+    WORD_TYPE **page = &mem->pages[address / EXT_PAGE_WORDS];
+    if (NULL == *page && allocate) {
+        *page = calloc(EXT_PAGE_WORDS, sizeof(WORD_TYPE));
+    }
+
+    return NULL == *page ? NULL : &(*page)[address % EXT_PAGE_WORDS];
+}
+
+
+
+// Reads a base or extended memory word, untouched pages reading as zero
+WORD_TYPE read_word( Memory *mem, size_t address ) {
+    WORD_TYPE *word = page_word(mem, address, 0);
+
+    return NULL == word ? 0 : *word;
+}
+
+
+
+// Marks the formatted memory row holding a word as needing sync
+void mark_dirty( Memory *mem, size_t word ) {
+    size_t row = word / MEMF_COLS;
+    mem->dirtyRows[row / 8] |= 1 << (row % 8);
+}
+
+
+
+// Synchronizes the formatted memory file to a RAM memory image
+// Only dirty rows are rewritten in place, unless the file layout needs regenerating
+int sync_memf( Memory *mem ) {
+    FILE *memf = fopen(FORMATTED_MEMORY, "r+b");    // Open formatted memory file
+    if (NULL == memf) { return MEMF_ACC_ERR; }
+
+    // Regenerate the whole table if the file doesn't hold exactly one
+    fseek(memf, 0, SEEK_END);
+    if (MEMF_HEADER_LEN + NUM_MEMF_ROWS * MEMF_ROW_LEN != ftell(memf)) {
+        if (fclose(memf)) { return MEMF_ACC_ERR; }
+        memf = fopen(FORMATTED_MEMORY, "wb");
+        if (NULL == memf) { return MEMF_ACC_ERR; }
+
+        fputs(MEMF_HEADER, memf);
+        memset(mem->dirtyRows, 0xff, sizeof(mem->dirtyRows));
+    }
+
+    // Write formatted contents of dirty rows
+    for (size_t row = 0; row < NUM_MEMF_ROWS; row++) {
+        if (!(mem->dirtyRows[row / 8] & (1 << (row % 8)))) { continue; }
+
+        fseek(memf, MEMF_HEADER_LEN + row * MEMF_ROW_LEN, SEEK_SET);
+        write_memf_row(memf, mem->words, row);
+    }
+
+    memset(mem->dirtyRows, 0, sizeof(mem->dirtyRows));
+
+    if (fclose(memf)) { return MEMF_ACC_ERR; }  // Close memf
+
+    return 0;
+}
+
+
+
+// Writes a row of formatted memory, its first word's address then a word a column
+void write_memf_row( FILE *memf, const WORD_TYPE words[], size_t row ) {
+    fprintf(memf, "%3zu", row * MEMF_COLS);
+    for (size_t word = row * MEMF_COLS; word < (row + 1) * MEMF_COLS && word < NUM_MEM_WORDS; word++) {
+        fprintf(memf, "   0x%04x%c", words[word], (word + 1) % MEMF_COLS ? ' ' : '\n');
+    }
+}
+
+
+
+// Requests a formatted memory sync at the next executed instruction
+void request_memf_refresh( int sig ) {
+    memfRefresh = 1;
+    signal(sig, request_memf_refresh);  // Re-arm for systems that reset handlers
+}
+
+
+
+// Clears TIMS memory
+int clear_mem( void ) {
+    Memory mem;     // RAM memory image
+    mem.pages = NULL;
+
+    if (read_mem(&mem)) {   // Unknown contents, so sync every row
+        memset(mem.words, 0xff, sizeof(mem.words));
+        memset(mem.dirtyRows, 0xff, sizeof(mem.dirtyRows));
+    }
+
+    // Drop extended memory by truncating the file to base memory
+    if (NULL != mem.pages) {
+        free_pages(&mem);
+        FILE *memory = fopen(MEMORY, "wb");
+        if (NULL == memory || fclose(memory)) { return MEM_ACC_ERR; }
+    }
+
+    // Only rows holding data need clearing in memf
+    for (size_t word = 0; word < NUM_MEM_WORDS; word++) {
+        if (mem.words[word]) {
+            mark_dirty(&mem, word);
+            mem.words[word] = 0x0;
+        }
+    }
+
+    // Clear memory file
+    if (write_mem(&mem)) { return MEM_ACC_ERR; }
+
+    int syncReturn = sync_memf(&mem);   // Sync memf
 
     return syncReturn;
-}
\ No newline at end of file
+}
@@ -0,0 +1,81 @@
+// Embeds a TIMS machine through the LIBRARY API of emulator.c compiled with TIMS_LIBRARY
+// Runs an assembled program in steps, then resets and reruns it from its loaded image
+// Usage: embed objectFile
+#include <stdio.h>
+#include <string.h>
+#include "tims.h"   // The LIBRARY API block of emulator.c
+
+#define NUM_RERUNS 1000
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        puts("Usage: embed objectFile");
+        return 1;
+    }
+
+    FILE *output = tmpfile();
+    Instance *instance = NULL == output ? NULL : create_instance(stdin, output);
+    if (NULL == instance) {
+        puts("FAIL: create_instance");
+        return 1;
+    }
+
+    int failed = 0;
+    MachineState state;
+    int numWords = load_instance(instance, &argv[1], 1, 0);
+    if (numWords <= 0) {
+        printf("FAIL: load_instance returned %d\n", numWords);
+        destroy_instance(instance);
+        return 1;
+    }
+
+    // Stop after two instructions, then run on to END
+    int status = run_instance(instance, 2);
+    query_instance(instance, &state);
+    if (INSTR_LIMIT != status || 2 != state.instrCount || 2 != state.instrPtr) {
+        printf("FAIL: run_instance stopped with %d at word %zu after %zu instructions\n", status, state.instrPtr, state.instrCount);
+        failed = 1;
+    }
+    status = run_instance(instance, 0);
+    query_instance(instance, &state);
+    size_t numInstrs = state.instrCount;
+    if (status || 5 != state.accumulator) {
+        printf("FAIL: run_instance ended with %d, accumulator %d\n", status, state.accumulator);
+        failed = 1;
+    }
+
+    // Every rerun starts over from the loaded image
+    for (size_t run = 0; !failed && run < NUM_RERUNS; run++) {
+        reset_instance(instance);
+        status = run_instance(instance, 0);
+        query_instance(instance, &state);
+        if (status || numInstrs != state.instrCount || 5 != state.accumulator) {
+            printf("FAIL: rerun %zu ended with %d after %zu instructions\n", run, status, state.instrCount);
+            failed = 1;
+        }
+    }
+    destroy_instance(instance);
+
+    // Each run printed its sum once
+    char line[16];
+    size_t numLines = 0;
+    rewind(output);
+    while (NULL != fgets(line, sizeof(line), output)) {
+        if (strcmp(line, "5\n")) {
+            printf("FAIL: printed \"%s\"\n", line);
+            failed = 1;
+            break;
+        }
+        numLines++;
+    }
+    fclose(output);
+    if (!failed && NUM_RERUNS + 1 != numLines) {
+        printf("FAIL: printed %zu lines\n", numLines);
+        failed = 1;
+    }
+
+    if (!failed) {
+        puts("PASS: embed");
+    }
+    return failed;
+}
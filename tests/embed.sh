@@ -0,0 +1,19 @@
+#!/bin/sh
+# Builds tests/embed.c against emulator.c compiled with TIMS_LIBRARY and runs it
+# The host includes the LIBRARY API block of emulator.c, taken out here as tims.h
+# Usage: tests/embed.sh [CC]
+set -u
+cc=${1:-cc}
+root=$(cd "$(dirname "$0")/.." && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+sed -n '/^\/\/ LIBRARY API$/,/^\/\/ End of LIBRARY API$/p' "$root/emulator.c" > tims.h
+$cc -O2 -Wall -o emulator "$root/emulator.c" -lpthread -lm || exit 1
+$cc -O2 -Wall -DTIMS_LIBRARY -c -o tims.o "$root/emulator.c" || exit 1
+$cc -O2 -Wall -I. -o embed "$root/tests/embed.c" tims.o -lpthread -lm || exit 1
+
+printf 'load A\nadd B\nstore C\nprti C\nend\nA: 2\nB: 3\nC: 0\n' > sum.txt
+./emulator as-1 sum.txt > /dev/null || { echo "FAIL: assemble"; exit 1; }
+./embed sumAsm.txt < /dev/null
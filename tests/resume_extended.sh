@@ -0,0 +1,25 @@
+#!/bin/sh
+# Snapshots a program running in extended memory, then resumes the snapshot
+# Both the run on after the snapshot and the resumed run must reach the end of extended memory
+# Usage: tests/resume_extended.sh path/to/emulator
+set -u
+emulator=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+printf 'b 4096\n' > program.txt
+: > memory_f.dat      # The emulator only rewrites a formatted memory file that exists
+end="Word 16777216 - invalid memory address"
+status=0
+
+"$emulator" ca-0 ex-1 snap-s.bin at-100 program.txt < /dev/null > snap.out
+grep -q 'Snapshot "s.bin" taken at word 4195 after 100 instructions' snap.out || { echo "FAIL: snapshot"; status=1; }
+grep -q "$end" snap.out || { echo "FAIL: run on after snapshot"; status=1; }
+
+"$emulator" ca-0 ex-1 resume-s.bin program.txt < /dev/null > resume.out
+grep -q 'Resumed snapshot "s.bin" at word 4195 after 100 instructions' resume.out || { echo "FAIL: resume"; status=1; }
+grep -q "$end" resume.out || { echo "FAIL: run on after resume"; status=1; }
+
+[ 0 -eq $status ] && echo "PASS: resume_extended"
+exit $status